@@ -1,6 +1,7 @@
 #define MJ_CLIENT_MODE_2D
 #include "renderer/2d.hpp"
 #include "game.hpp"
+#include <cstdlib>
 #include <thread>
 
 void run_game()
@@ -11,23 +12,42 @@ void run_game()
 }
 
 
+/*
+ * The renderer is created here, so the OpenGL context belongs to the main
+ * thread, before the game thread submits anything. With MJ_FRAME_TRACE set,
+ * the frame times are written to that file on exit.
+ */
 int main(int argc, char *argv[])
 {
+    GLFWwindow *window = renderer2d::window_ptr();
     std::thread t(run_game);
     t.detach();
 
     glfwSetMouseButtonCallback(renderer2d::window_ptr(), input::on_mouse_button);
     glfwSetKeyCallback(renderer2d::window_ptr(), input::on_key);
+    hint_worker::on_publish(glfwPostEmptyEvent);
     glClearColor(0.1f, 0.4f, 0.0f, 0.5f);
 
     while (!glfwWindowShouldClose(renderer2d::window_ptr()))
     {
+        renderer2d::frames().begin_frame();
+
+        /* The hints of the worker, in the title as soon as they are ready */
+        bool fresh_hints;
+        auto const &hints = hint_worker::latest(&fresh_hints);
+        if (fresh_hints)
+            glfwSetWindowTitle(window, ("Washizu Mahjong - " + hints.summary()).c_str());
+
         glClear(GL_COLOR_BUFFER_BIT);
 
         renderer2d::flush();
 
-        glfwSwapBuffers(renderer2d::window_ptr());
+        glfwSwapBuffers(window);
+        renderer2d::frames().end_frame();
         glfwWaitEvents();
     }
+
+    if (char const *path = std::getenv("MJ_FRAME_TRACE"))
+        renderer2d::frames().dump(path);
     return 0;
 }
@@ -0,0 +1,54 @@
+#define MJ_CLIENT_MODE_3D
+#include "renderer/3d.hpp"
+#include "game.hpp"
+#include <cstdlib>
+#include <thread>
+
+void run_game()
+{
+    game g(input::istream::get, R::protocol::v4(), MJ_SERVER_DEFAULT_PORT);
+    while (g.turn())
+        {}
+}
+
+
+/*
+ * The renderer is created here, so the OpenGL context and the camera belong
+ * to the main thread, before the game thread submits anything. With
+ * MJ_FRAME_TRACE set, the frame times are written to that file on exit, which
+ * also works without a GPU, under Mesa with LIBGL_ALWAYS_SOFTWARE=1.
+ */
+int main(int argc, char *argv[])
+{
+    GLFWwindow *window = renderer3d::window_ptr();
+    std::thread t(run_game);
+    t.detach();
+
+    glfwSetMouseButtonCallback(renderer3d::window_ptr(), input::on_mouse_button);
+    glfwSetKeyCallback(renderer3d::window_ptr(), input::on_key);
+    hint_worker::on_publish(glfwPostEmptyEvent);
+    glClearColor(0.1f, 0.4f, 0.0f, 0.5f);
+
+    while (!glfwWindowShouldClose(renderer3d::window_ptr()))
+    {
+        renderer3d::frames().begin_frame();
+
+        /* The hints of the worker, in the title as soon as they are ready */
+        bool fresh_hints;
+        auto const &hints = hint_worker::latest(&fresh_hints);
+        if (fresh_hints)
+            glfwSetWindowTitle(window, ("Washizu Mahjong - " + hints.summary()).c_str());
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        renderer3d::flush();
+
+        glfwSwapBuffers(window);
+        renderer3d::frames().end_frame();
+        glfwWaitEvents();
+    }
+
+    if (char const *path = std::getenv("MJ_FRAME_TRACE"))
+        renderer3d::frames().dump(path);
+    return 0;
+}
@@ -1,8 +1,11 @@
 #include "receiver.hpp"
+#include <cstring>
 #include <iostream>
-int main()
+int main(int argc, char **argv)
 {
-    R interface(R::protocol::v4(), 10000);
+    /* --shm: the server runs on this machine, use a shared memory link */
+    bool const shared_memory = argc > 1 && strcmp(argv[1], "--shm") == 0;
+    R interface(R::protocol::v4(), 10000, shared_memory);
 
     // send a connection request
     msg::buffer msg = interface.recv();
@@ -50,6 +50,7 @@ namespace input = input_3d;
 #include "mahjong/interaction.h"
 #include "utils/optim.hpp"
 #include "receiver.hpp"
+#include "hints.hpp"
 #include <vector>
 #include <functional>
 /**
@@ -81,8 +82,7 @@ public:
     static constexpr int STARTING_PTS           = 30000;
     using card_type         = mj_tile;
     using score_type        = int;
-    using discards_allocator= optim<MAX_DISCARD_PER_PLAYER>::allocator<card_type>;
-    using discards_type     = std::vector<card_type, discards_allocator>;
+    using discards_type     = small_vector<card_type, MAX_DISCARD_PER_PLAYER>;
 
 public:
     template <typename IPType>
@@ -112,7 +112,7 @@ private:
     std::array<mj_meld, NUM_PLAYERS> melds {};
     std::array<score_type, NUM_PLAYERS> scores {};
     std::array<discards_type, NUM_PLAYERS> discards {};
-    std::vector<card_type, optim<MAX_DORAS*2>::allocator<card_type>> doras {};
+    small_vector<card_type, MAX_DORAS*2> doras {};
 
     int my_pos;
     msg::id_type my_uid;
@@ -139,6 +139,13 @@ private:
     void start_round();
     void start_round_update();
 
+    /**
+     * Replace the whole state with a snapshot from the server, sent when
+     * reconnecting or spectating. The opaque tiles of the others are received
+     * as MJ_INVALID_TILE.
+     */
+    void load_snapshot();
+
     /**
      * Expect the draw of a tile from the server. If the tile is
      * MJ_INVALID_TILE, then it must be an opaque tile drawn by another player.
@@ -185,6 +192,12 @@ private:
      */
     void payment();
 
+    /**
+     * Post your hand, and the tiles you see, to the hint worker to be
+     * analysed in the background.
+     */
+    void post_hints() const;
+
 private:
     /**
      * Process an invalid message from the server by throwing an exception
@@ -8,6 +8,10 @@ struct call {
 };
 
 
+/*
+ * The renderer retains what was submitted, so an event only submits the areas
+ * it changed and publishes them. resubmit submits everything.
+ */
 void game::resubmit() const
 {
     renderer2d::clear();
@@ -20,6 +24,7 @@ void game::resubmit() const
     renderer2d::submit(400, {10.f, 10.f}, 0);
 
     renderer2d::submit_calls();
+    renderer2d::publish();
     glfwPostEmptyEvent();
 }
 
@@ -28,6 +33,8 @@ void game::start_round_update()
     renderer2d::clear();
     for (int i = 0; i < NUM_PLAYERS; ++i)
         renderer2d::submit(hands[i], (i - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::draw()
@@ -45,7 +52,9 @@ void game::draw()
 
     cur_player = player;
 
-    resubmit();
+    renderer2d::submit(hands[player], (player - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::discard()
@@ -60,7 +69,10 @@ void game::discard()
     if (cur_player != my_pos)
         check_calls();
 
-    resubmit();
+    renderer2d::submit(hands[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::submit(discards[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::check_calls()
@@ -89,7 +101,11 @@ void game::player_pong()
     auto triple = MJ_OPEN_TRIPLE(MJ_TRIPLE(meld_tiles[0], meld_tiles[1], meld_tiles[2]));
     mj_add_meld(&melds[cur_player], MJ_CALL_TRIPLE(triple, (from - cur_player) & 3));
 
-    resubmit();
+    renderer2d::submit(discards[from], (from - my_pos) & 3);
+    renderer2d::submit(hands[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::submit(melds[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::player_kong()
@@ -113,7 +129,10 @@ void game::player_kong()
         meld_tiles[0], meld_tiles[1], meld_tiles[2])));
     mj_add_meld(&melds[cur_player], MJ_CALL_TRIPLE(triple, (from - cur_player) & 3));
 
-    resubmit();
+    renderer2d::submit(hands[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::submit(melds[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::self_kong()
@@ -139,7 +158,10 @@ void game::self_kong()
             t, t^1, t^2)));
     }
 
-    resubmit();
+    renderer2d::submit(hands[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::submit(melds[cur_player], (cur_player - my_pos) & 3);
+    renderer2d::publish();
+    glfwPostEmptyEvent();
 }
 
 void game::payment()
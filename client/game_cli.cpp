@@ -95,7 +95,7 @@ void game::after_draw()
 
 
     std::cout << "1-" << hands[my_pos].size << ") Discard Tile\n";
-
+    std::cout << "?) Hints\n";
 }
 
 void game::discard()
@@ -77,6 +77,111 @@ void game::start_round()
     start_round_update();
 }
 
+void game::load_snapshot()
+{
+    for (auto &p_hand : hands)
+        mj_empty_hand(&p_hand);
+    for (auto &p_discards : discards)
+        p_discards.clear();
+    for (auto &p_melds : melds)
+        mj_empty_melds(&p_melds);
+    doras.clear();
+    in_riichi = false;
+
+    int p = 0;
+    unsigned short meld_low = 0;
+    for (buf = interface.recv(); msg::type(buf) != msg::header::snapshot;
+        buf = interface.recv())
+    {
+        switch (msg::type(buf))
+        {
+        case msg::header::new_round:
+            prevailing_wind = msg::data<unsigned short>(buf) >> 2;
+            round_no = msg::data<unsigned short>(buf) & 3;
+            break;
+        case msg::header::your_position:
+            my_pos = msg::data<int>(buf);
+            break;
+        case msg::header::current_player:
+            cur_player = msg::data<int>(buf);
+            break;
+        case msg::header::dora_indicator:
+            doras.push_back(msg::data<mj_tile>(buf));
+            break;
+        case msg::header::seat:
+            p = msg::data<int>(buf) & 3;
+            break;
+        case msg::header::seat_score:
+            scores[p] = msg::data<short>(buf) * 100;
+            break;
+        case msg::header::closed_hand:
+            break;
+        case msg::header::tile:
+            mj_add_tile(&hands[p], msg::data<mj_tile>(buf));
+            break;
+        case msg::header::meld_low:
+            meld_low = msg::data<unsigned short>(buf);
+            break;
+        case msg::header::meld_high:
+            mj_add_meld(&melds[p],
+                static_cast<mj_triple>(msg::data<unsigned short>(buf)) << 16 | meld_low);
+            break;
+        case msg::header::discarded:
+            discards[p].push_back(msg::data<mj_tile>(buf));
+            break;
+        case msg::header::this_player_riichi:
+            in_riichi = (p == my_pos) ? true : in_riichi;
+            break;
+        default:
+            throw server_exception("Invalid snapshot.");
+        }
+    }
+
+    seat_wind = (my_pos - round_no) & 3;
+    start_round_update();
+}
+
+
+void game::post_hints() const
+{
+    /* A called tile may still be in the pile it was called from (the server
+     * and the snapshots keep it there), so the tiles are counted by copy,
+     * each once. The fourth copy of a kong is not stored in the meld, but
+     * the meld holds all four. Your melds are counted by the worker. */
+    std::array<bool, 1 << 9> counted {};
+    hint_worker::seen_type seen {};
+    auto const count = [&](mj_tile tile, bool is_seen) {
+        if (counted[tile & 0x1ff])
+            return;
+        counted[tile & 0x1ff] = true;
+        if (is_seen)
+            ++seen[MJ_ID_34(tile)];
+    };
+    auto const count_melds = [&](mj_meld const &m, bool is_seen) {
+        for (mj_size i = 0; i < m.size; ++i)
+        {
+            mj_triple const meld = m.melds[i];
+            count(MJ_FIRST(meld), is_seen);
+            count(MJ_SECOND(meld), is_seen);
+            count(MJ_THIRD(meld), is_seen);
+            if (MJ_IS_KONG(meld))
+                for (mj_tile sub = 0; sub < 4; ++sub)
+                    count((MJ_FIRST(meld) & ~3u) | sub, is_seen);
+        }
+    };
+
+    count_melds(melds[my_pos], false);
+    for (int p = 0; p < NUM_PLAYERS; ++p)
+        if (p != my_pos)
+            count_melds(melds[p], true);
+    for (auto const &pile : discards)
+        for (mj_tile tile : pile)
+            count(tile, true);
+    for (mj_tile tile : doras)
+        count(tile, true);
+
+    hint_worker::post(hands[my_pos], melds[my_pos], seen);
+}
 
 void game::command(std::function<void(std::string&)> const &get)
 {
@@ -174,6 +279,16 @@ void game::command(std::function<void(std::string&)> const &get)
             interface.send(msg::header::discard_tile, cur_tile);
             DEBUG_PRINT("Tried to tsumogiri\n");
             break;
+        case '?':
+        {
+            auto const &hints = hint_worker::latest();
+            std::cout << (hints.generation ? hints.summary() : "No hints yet.") << '\n';
+            for (mj_size i = 0; i < hints.num_discards; ++i)
+                std::cout << "  " << hint_worker::tile_name(hints.discards[i].tile) << ": " <<
+                    hints.discards[i].shanten << " shanten, " <<
+                    hints.discards[i].acceptance << " tiles\n";
+            break;
+        }
         case '0' ... '9':
         {
             int t = std::stoi(cmd)-1;
@@ -199,11 +314,15 @@ bool game::turn()
         return false;
 
     buf = interface.recv();
-    switch(msg::type(buf))
+    auto const type = msg::type(buf);
+    switch(type)
     {
     case msg::header::new_round:
         start_round();
         break;
+    case msg::header::snapshot:
+        load_snapshot();
+        break;
     case msg::header::this_player_won:
         payment();
         break;
@@ -243,5 +362,22 @@ bool game::turn()
         return false;
     }
 
+    /* Every event that changes your hand or the tiles you see */
+    switch (type)
+    {
+    case msg::header::this_player_drew:
+        if (cur_player == my_pos)
+            post_hints();
+        break;
+    case msg::header::new_round: case msg::header::snapshot:
+    case msg::header::tile: case msg::header::tsumogiri_tile:
+    case msg::header::this_player_pong: case msg::header::this_player_chow:
+    case msg::header::this_player_kong: case msg::header::dora_indicator:
+        post_hints();
+        break;
+    default:
+        break;
+    }
+
     return true;
 }
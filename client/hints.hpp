@@ -0,0 +1,300 @@
+#ifndef MJ_CLIENT_HINTS_HPP
+#define MJ_CLIENT_HINTS_HPP
+
+#include "mahjong/mahjong.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+
+/**
+ * @brief The worker thread that analyses your hand for hints: how far it is
+ * from tenpai (shanten), and the tiles that bring it closer (ukeire), or with
+ * the drawn tile, what each discard leaves.
+ *
+ * @details The game thread posts the hand after every draw, discard and call,
+ * and never waits: the jobs are handed to the worker through a triple buffer
+ * with an atomic index, like the frames of the renderers. A job posted while
+ * the worker analyses another cancels it, as the worker checks between the
+ * discards and moves to the newest. The hints are published the same way, so
+ * the UI takes the latest without a lock, and is told when there are new ones.
+ *
+ * It is a singleton, shared by the game thread and the UI.
+ */
+class hint_worker
+{
+public:
+    using seen_type = std::array<unsigned char, MJ_UNIQUE_TILES>;
+
+    /* What discarding a tile of the hand leaves */
+    struct discard_hint
+    {
+        mj_tile tile;
+        int shanten;
+        int acceptance;
+    };
+
+    struct hints
+    {
+        /* The post these hints answer, 0 for none */
+        unsigned long long generation = 0;
+        int shanten = 8;
+
+        /* The kinds that lower the shanten of a hand without a drawn tile,
+         * and how many of them are still unseen */
+        mj_mask ukeire = 0;
+        int acceptance = 0;
+
+        /* With a drawn tile, each kind of the hand, best discard first */
+        mj_size num_discards = 0;
+        std::array<discard_hint, MJ_MAX_HAND_SIZE> discards {};
+
+        /**
+         * @return The hints in a line, like "1 shanten, discard 9m (22
+         * tiles)", empty if there are none.
+         */
+        std::string summary() const
+        {
+            if (!generation)
+                return {};
+
+            std::string line = shanten < 0 ? "Complete"
+                : shanten == 0 ? "Tenpai" : std::to_string(shanten) + " shanten";
+            if (num_discards)
+                return line + ", discard " + tile_name(discards[0].tile) +
+                    " (" + std::to_string(discards[0].acceptance) + " tiles)";
+            if (!ukeire)
+                return line;
+
+            line += ", " + std::to_string(acceptance) + " tiles:";
+            for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
+                if (ukeire & (mj_mask)1 << kind)
+                    line += " " + tile_name(tile_of_kind(kind));
+            return line;
+        }
+    };
+
+public:
+    ~hint_worker()
+    {
+        jobs_latest.fetch_or(STOP, std::memory_order_release);
+        jobs_latest.notify_one();
+        worker.join();
+    }
+
+    hint_worker(hint_worker const &) = delete;
+    hint_worker &operator=(hint_worker const &) = delete;
+
+    static hint_worker &get_instance()
+    {
+        static hint_worker instance;
+        return instance;
+    }
+
+    /**
+     * @brief Analyse a hand, cancelling the job of the previous one. Game
+     * thread only.
+     *
+     * @param hand Your hand, with the drawn tile or not.
+     * @param melds Your open melds.
+     * @param seen The copies of each kind you see outside of your hand and
+     * melds: the discards, the melds of the others and the dora indicators,
+     * a called tile only once.
+     */
+    static void post(mj_hand const &hand, mj_meld const &melds, seen_type const &seen) noexcept
+    {
+        get_instance().post_impl(hand, melds, seen);
+    }
+
+    /**
+     * @brief The latest hints published. UI thread only.
+     *
+     * @param fresh Set to whether they are new since the last call.
+     */
+    static hints const &latest(bool *fresh = nullptr) noexcept
+    {
+        return get_instance().latest_impl(fresh);
+    }
+
+    /**
+     * @brief Call a function on the worker thread whenever hints are
+     * published, to wake the UI (glfwPostEmptyEvent for example).
+     */
+    static void on_publish(void (*notify)()) noexcept
+    {
+        get_instance().notify.store(notify, std::memory_order_release);
+    }
+
+    static std::string tile_name(mj_tile tile)
+    {
+        static constexpr char SUITS[] = "mpswd";
+        return { static_cast<char>('1' + MJ_NUMBER(tile)), SUITS[MJ_SUIT(tile)] };
+    }
+
+private:
+    hint_worker() : worker(&hint_worker::work, this) {}
+
+    /* Set in an index when the slot was published and not taken yet */
+    static constexpr unsigned FRESH = 4;
+    /* Set in the index of the jobs to stop the worker */
+    static constexpr unsigned STOP = 8;
+
+    struct job
+    {
+        unsigned long long generation = 0;
+        mj_hand hand {};
+        mj_meld melds {};
+        seen_type seen {};
+    };
+
+    std::array<job, 3> jobs {};
+    unsigned jobs_building = 0;     /* game thread */
+    unsigned jobs_taken = 1;        /* worker */
+    std::atomic<unsigned> jobs_latest { 2 };
+    std::atomic<unsigned long long> posted { 0 };
+
+    std::array<hints, 3> results {};
+    unsigned results_building = 0;  /* worker */
+    unsigned results_presented = 1; /* UI thread */
+    std::atomic<unsigned> results_latest { 2 };
+
+    std::atomic<void (*)()> notify { nullptr };
+
+    std::thread worker;
+
+    static mj_tile tile_of_kind(int kind) noexcept
+    {
+        if (kind < 27)
+            return MJ_TILE(kind / 9, kind % 9, 0);
+        if (kind < 31)
+            return MJ_TILE(MJ_WIND, kind - 27, 0);
+        return MJ_TILE(MJ_DRAGON, kind - 31, 0);
+    }
+
+    void post_impl(mj_hand const &hand, mj_meld const &melds, seen_type const &seen) noexcept
+    {
+        auto &j = jobs[jobs_building];
+        j.generation = posted.fetch_add(1, std::memory_order_relaxed) + 1;
+        j.hand = hand;
+        j.melds = melds;
+        j.seen = seen;
+        jobs_building = jobs_latest.exchange(jobs_building | FRESH, std::memory_order_acq_rel)
+            & ~FRESH;
+        jobs_latest.notify_one();
+    }
+
+    hints const &latest_impl(bool *fresh) noexcept
+    {
+        bool const is_fresh = results_latest.load(std::memory_order_acquire) & FRESH;
+        if (is_fresh)
+            results_presented = results_latest.exchange(results_presented,
+                std::memory_order_acq_rel) & ~FRESH;
+        if (fresh)
+            *fresh = is_fresh;
+        return results[results_presented];
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            unsigned latest = jobs_latest.load(std::memory_order_acquire);
+            while (!(latest & (FRESH | STOP)))
+            {
+                jobs_latest.wait(latest, std::memory_order_acquire);
+                latest = jobs_latest.load(std::memory_order_acquire);
+            }
+            /* STOP may be set since the load, and is cleared by the exchange */
+            latest = jobs_latest.exchange(jobs_taken, std::memory_order_acq_rel);
+            if (latest & STOP)
+                return;
+            jobs_taken = latest & ~FRESH;
+
+            if (!analyse(jobs[jobs_taken], results[results_building]))
+                continue;
+            results_building = results_latest.exchange(results_building | FRESH,
+                std::memory_order_acq_rel) & ~FRESH;
+            if (auto wake = notify.load(std::memory_order_acquire))
+                wake();
+        }
+    }
+
+    /* A newer job was posted, this one is stale */
+    bool cancelled(job const &j) const noexcept
+    {
+        return posted.load(std::memory_order_relaxed) != j.generation;
+    }
+
+    /* The tiles of the kinds accepted that are not in the hand, the melds,
+     * seen, or the tile just discarded if any */
+    static int acceptance(mj_hand const &hand, job const &j, mj_mask ukeire,
+        mj_tile discarded = MJ_INVALID_TILE) noexcept
+    {
+        int held[MJ_UNIQUE_TILES] {};
+        if (discarded != MJ_INVALID_TILE)
+            ++held[MJ_ID_34(discarded)];
+        for (mj_size i = 0; i < hand.size; ++i)
+            ++held[MJ_ID_34(hand.tiles[i])];
+        for (mj_size i = 0; i < j.melds.size; ++i)
+        {
+            mj_triple const meld = j.melds.melds[i];
+            ++held[MJ_ID_34(MJ_FIRST(meld))];
+            ++held[MJ_ID_34(MJ_SECOND(meld))];
+            held[MJ_ID_34(MJ_THIRD(meld))] += MJ_IS_KONG(meld) ? 2 : 1;
+        }
+
+        int tiles = 0;
+        for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
+            if (ukeire & (mj_mask)1 << kind)
+                tiles += std::max(4 - held[kind] - j.seen[kind], 0);
+        return tiles;
+    }
+
+    /**
+     * Analyse the hand of a job into hints.
+     *
+     * @return false if the job was cancelled.
+     */
+    bool analyse(job const &j, hints &h) const noexcept
+    {
+        h.generation = j.generation;
+        h.shanten = mj_shanten(j.hand, j.melds);
+        h.ukeire = 0;
+        h.acceptance = 0;
+        h.num_discards = 0;
+
+        if ((j.hand.size + 3 * j.melds.size) % 3 != 2)
+        {
+            h.ukeire = mj_ukeire(j.hand, j.melds);
+            h.acceptance = acceptance(j.hand, j, h.ukeire);
+            return !cancelled(j);
+        }
+
+        mj_mask tried = 0;
+        for (mj_size i = 0; i < j.hand.size; ++i)
+        {
+            mj_tile const tile = j.hand.tiles[i];
+            if (tried & MJ_KIND_BIT(tile))
+                continue;
+            tried |= MJ_KIND_BIT(tile);
+            if (cancelled(j))
+                return false;
+
+            mj_hand rest = j.hand;
+            rest.tiles[i] = rest.tiles[--rest.size];
+            mj_mask const ukeire = mj_ukeire(rest, j.melds);
+            h.discards[h.num_discards++] = { tile, mj_shanten(rest, j.melds),
+                acceptance(rest, j, ukeire, tile) };
+        }
+
+        std::sort(h.discards.begin(), h.discards.begin() + h.num_discards,
+            [](discard_hint const &a, discard_hint const &b) {
+                return a.shanten != b.shanten ? a.shanten < b.shanten
+                    : a.acceptance > b.acceptance;
+            });
+        return !cancelled(j);
+    }
+};
+
+#endif
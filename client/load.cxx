@@ -0,0 +1,454 @@
+#define ASIO_STANDALONE
+#include <asio.hpp>
+#include "utils/message.hpp"
+#include "server/histogram.hpp"
+#include "mahjong/mahjong.h"
+#include "mahjong/interaction.h"
+#include "mahjong/yaku.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+/*
+ * Load generator for the server: many bots, each with its own connection,
+ * all driven by one io_context on one thread.
+ *
+ * Usage: LoadClient [-a address] [-p port] [-n bots] [-d seconds] [-c percent] [-t]
+ *
+ * The bots join as new players and play legal moves as fast as they can: on
+ * their draw they discard a random tile of their hand, and when another
+ * player discards they answer every call the server may wait for. With -c,
+ * they call ron and tsumo whenever they can, and pong or chow with the given
+ * chance, otherwise they pass. They declare tenpai honestly at exhaustive
+ * draws.
+ *
+ * Every second a line of counters is printed, and the totals at the end, as
+ * tab separated values with -t. The turn latency is from a bot sending its
+ * discard to the server broadcasting it back, so it is the time the server
+ * takes to handle a turn, plus a round trip on the loopback.
+ */
+
+using protocol      = asio::ip::tcp;
+using clock_type    = std::chrono::steady_clock;
+
+struct options
+{
+    std::string     address     = "127.0.0.1";
+    unsigned short  port        = MJ_SERVER_DEFAULT_PORT;
+    int             bots        = 1000;
+    int             seconds     = 60;
+    int             call_chance = 0;    /* percent, 0 never calls */
+    bool            tsv         = false;
+};
+
+struct statistics
+{
+    unsigned long long connected = 0, in_game = 0, rounds = 0;
+    unsigned long long messages_in = 0, messages_out = 0;
+    unsigned long long connect_failures = 0, disconnects = 0, rejects = 0;
+    unsigned long long timeouts = 0;    /* turns the server played for a bot */
+    unsigned long long calls = 0;
+    latency_histogram turn;
+};
+
+class bot : public std::enable_shared_from_this<bot>
+{
+public:
+    bot(asio::io_context &context, protocol::endpoint endpoint,
+        options const &opts, statistics &stats, unsigned seed)
+        : socket(context), endpoint(endpoint), opts(opts), stats(stats), rng(seed) {}
+
+    void start()
+    {
+        socket.async_connect(endpoint, [self = shared_from_this()](asio::error_code ec) {
+            if (ec)
+            {
+                ++self->stats.connect_failures;
+                return;
+            }
+            ++self->stats.connected;
+            self->read();
+        });
+    }
+
+private:
+    protocol::socket    socket;
+    protocol::endpoint  endpoint;
+    options const       &opts;
+    statistics          &stats;
+    std::minstd_rand    rng;
+
+    msg::buffer             in;
+    std::deque<msg::buffer> out;
+
+    /* The bytes read and not handled, a message cut by the read at most */
+    std::array<char, 64 * msg::BUFFER_SIZE> received;
+    std::size_t             received_size = 0;
+
+    /* What the bot knows of the game */
+    int         pos = -1;
+    int         prevailing_wind = 0, dealer = 0;
+    int         cur_player = 0;
+    int         drawer = -1;        /* the next tile is drawn by this player */
+    int         skip_tiles = 0;     /* tiles of a call being broadcast */
+    bool        dealing = false, in_stream = false;
+    mj_tile     cur_tile = MJ_INVALID_TILE;
+    mj_hand     hand {};
+    mj_meld     melds {};
+    mj_mask     discarded = 0;      /* kinds we discarded, for furiten */
+    mj_pair     offered = 0;        /* the tiles we called with */
+    clock_type::time_point discard_sent;
+
+    /* Read whatever was sent, and handle every whole message of it */
+    void read()
+    {
+        socket.async_read_some(asio::buffer(received.data() + received_size,
+            received.size() - received_size),
+            [self = shared_from_this()](asio::error_code ec, std::size_t length) {
+                if (ec)
+                {
+                    ++self->stats.disconnects;
+                    if (self->pos >= 0)
+                        --self->stats.in_game;
+                    --self->stats.connected;
+                    return;
+                }
+                self->received_size += length;
+                std::size_t pos = 0;
+                for (; pos + msg::BUFFER_SIZE <= self->received_size; pos += msg::BUFFER_SIZE)
+                {
+                    std::copy_n(self->received.begin() + pos, msg::BUFFER_SIZE, self->in.begin());
+                    ++self->stats.messages_in;
+                    self->handle();
+                }
+                std::copy(self->received.begin() + pos,
+                    self->received.begin() + self->received_size, self->received.begin());
+                self->received_size -= pos;
+                self->read();
+            });
+    }
+
+    template <typename ObjType>
+    void send(msg::header header, ObjType obj)
+    {
+        out.push_back(msg::buffer_data(header, obj));
+        ++stats.messages_out;
+        if (out.size() == 1)
+            write();
+    }
+
+    /* One write in flight at a time, the queue keeps the order */
+    void write()
+    {
+        asio::async_write(socket, asio::buffer(out.front(), msg::BUFFER_SIZE),
+            [self = shared_from_this()](asio::error_code ec, std::size_t) {
+                if (ec)
+                    return;
+                self->out.pop_front();
+                if (!self->out.empty())
+                    self->write();
+            });
+    }
+
+    bool calls() { return opts.call_chance > 0; }
+    bool maybe_call() { return calls() && int(rng() % 100) < opts.call_chance; }
+
+    int seat_wind(int p) const { return (4 + p - dealer) % 4; }
+
+    /* The score if the hand won on the tile, 0 if it cannot */
+    int score_with(mj_tile tile, mj_bool tsumo)
+    {
+        mj_hand tmp = hand;
+        if (!tsumo)
+            tmp.tiles[tmp.size++] = tile;
+        mj_sort_hand(&tmp);
+        int fu = 0, fan = 0;
+        std::array<unsigned short, MJ_YAKU_ARR_SIZE> yakus {};
+        int score = mj_score(&fu, &fan, yakus.data(), &tmp, &melds, tile, tsumo,
+            prevailing_wind, seat_wind(pos));
+        return fan > 0 ? score : 0;
+    }
+
+    bool tenpai()
+    {
+        mj_hand tmp = hand;
+        mj_sort_hand(&tmp);
+        return mj_tenpai(tmp, melds, nullptr) > 0;
+    }
+
+    bool waits_on(mj_tile tile)
+    {
+        mj_hand tmp = hand;
+        mj_sort_hand(&tmp);
+        std::array<mj_id, MJ_UNIQUE_TILES> waits;
+        mj_size n = mj_tenpai(tmp, melds, waits.data());
+        return std::find(waits.begin(), waits.begin() + n, MJ_ID_34(tile))
+            != waits.begin() + n;
+    }
+
+    void discard()
+    {
+        mj_tile const tile = hand.tiles[rng() % hand.size];
+        mj_discard_tile(&hand, tile);
+        discarded |= MJ_KIND_BIT(tile);
+        discard_sent = clock_type::now();
+        send(msg::header::discard_tile, tile);
+    }
+
+    void drew(mj_tile tile)
+    {
+        mj_add_tile(&hand, tile);
+        if (dealing)
+            return;
+        if (calls() && score_with(tile, MJ_TRUE))
+        {
+            ++stats.calls;
+            send(msg::header::call_tsumo, pos);
+            return;
+        }
+        discard();
+    }
+
+    /*
+     * Answer what the server may wait for, it flushes the answers it did not
+     * read at the next draw. Bots never riichi, so all calls are open.
+     */
+    void opponent_discarded(mj_tile tile)
+    {
+        mj_mask const bit = MJ_KIND_BIT(tile);
+        bool const next = ((cur_player + 1) & 3) == pos;
+        bool const ron = !(discarded & bit) && waits_on(tile);
+
+        if (ron && calls() && score_with(tile, MJ_FALSE))
+        {
+            ++stats.calls;
+            send(msg::header::call_ron, pos);
+            return;
+        }
+
+        mj_pair pair;
+        std::array<mj_pair, 16> chows;
+        if ((hand.pong_mask & bit) && maybe_call()
+            && mj_pong_available(hand, tile, &pair))
+        {
+            ++stats.calls;
+            offered = pair;
+            send(msg::header::call_pong, pos);
+            send(msg::header::call_with_tile, MJ_FIRST(pair));
+            send(msg::header::call_with_tile, MJ_SECOND(pair));
+        }
+        else if (next && (hand.chow_mask & bit) && maybe_call()
+            && mj_chow_available(hand, tile, chows.data()))
+        {
+            ++stats.calls;
+            offered = chows[0];
+            send(msg::header::call_chow, pos);
+            send(msg::header::call_with_tile, MJ_FIRST(offered));
+            send(msg::header::call_with_tile, MJ_SECOND(offered));
+        }
+        else if (ron || (hand.pong_mask & bit) || (hand.kong_mask & bit)
+            || (next && (hand.chow_mask & bit)))
+            send(msg::header::pass_calls, pos);
+    }
+
+    /* The server took our pong or chow: the called tiles leave the hand */
+    void called()
+    {
+        mj_discard_tile(&hand, MJ_FIRST(offered));
+        mj_discard_tile(&hand, MJ_SECOND(offered));
+        mj_add_meld(&melds, MJ_OPEN_TRIPLE(MJ_TRIPLE(cur_tile,
+            MJ_FIRST(offered), MJ_SECOND(offered))));
+        discard();
+    }
+
+    void tile(mj_tile tile, bool tsumogiri)
+    {
+        if (in_stream)
+            return;
+        if (skip_tiles)
+        {
+            --skip_tiles;
+            return;
+        }
+        if (drawer >= 0)
+        {
+            cur_player = drawer;
+            drawer = -1;
+            if (cur_player == pos)
+                drew(tile);
+            return;
+        }
+
+        cur_tile = tile;
+        if (cur_player == pos)
+        {
+            if (tsumogiri)
+            {
+                /* The server discarded for us, our hand is out of date */
+                ++stats.timeouts;
+                mj_discard_tile(&hand, tile);
+                discarded |= MJ_KIND_BIT(tile);
+            }
+            else
+                stats.turn.record(clock_type::now() - discard_sent);
+        }
+        else
+            opponent_discarded(tile);
+    }
+
+    void handle()
+    {
+        unsigned short const data = msg::data<unsigned short>(in);
+        switch (msg::type(in))
+        {
+        case msg::header::ping:
+            out.push_back(in);
+            if (out.size() == 1)
+                write();
+            break;
+        case msg::header::your_id:
+            send(msg::header::join_as_player, msg::NEW_PLAYER);
+            send(msg::header::my_id, data);
+            break;
+        case msg::header::your_position:
+            pos = data;
+            ++stats.in_game;
+            break;
+        case msg::header::new_round:
+            prevailing_wind = data >> 2;
+            dealer = data & 3;
+            mj_empty_hand(&hand);
+            mj_empty_melds(&melds);
+            discarded = 0;
+            dealing = true;
+            in_stream = false;
+            skip_tiles = 0;
+            drawer = -1;
+            ++stats.rounds;
+            break;
+        case msg::header::dora_indicator:
+            dealing = false;
+            break;
+        case msg::header::this_player_drew:
+            drawer = data;
+            break;
+        case msg::header::tile:
+            tile(data, false);
+            break;
+        case msg::header::tsumogiri_tile:
+            tile(data, true);
+            break;
+        case msg::header::this_player_pong: case msg::header::this_player_chow:
+            cur_player = data;
+            skip_tiles = 2;
+            if (cur_player == pos)
+                called();
+            break;
+        case msg::header::this_player_kong:
+            skip_tiles = (int(data) == cur_player) ? 1 : 3;
+            cur_player = data;
+            break;
+        case msg::header::closed_hand:
+            in_stream = data == msg::START_STREAM;
+            break;
+        case msg::header::game_draw:
+            if (data == msg::EXHAUSTIVE_DRAW)
+                send(msg::header::call_tenpai, tenpai() ? msg::TENPAI : msg::NO_TEN);
+            break;
+        case msg::header::reject:
+            ++stats.rejects;
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+static void print(statistics const &stats, double seconds, bool header, bool tsv)
+{
+    if (header && !tsv)
+        printf("%8s %9s %8s %8s %10s %10s %10s %10s %9s %8s %8s %8s %7s\n",
+            "time", "connected", "in game", "rounds", "msgs in/s", "msgs out/s",
+            "turn p50", "turn p99", "failures", "rejects", "timeouts", "turns", "calls");
+    /* The percentiles are in microseconds */
+    double const p50 = stats.turn.percentile(50) / 1e3, p99 = stats.turn.percentile(99) / 1e3;
+    unsigned long long const failures = stats.connect_failures + stats.disconnects;
+    if (tsv)
+        printf("%.1f\t%llu\t%llu\t%llu\t%.1f\t%.1f\t%.3f\t%.3f\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+            seconds, stats.connected, stats.in_game, stats.rounds,
+            stats.messages_in / seconds, stats.messages_out / seconds, p50, p99,
+            failures, stats.rejects, stats.timeouts,
+            (unsigned long long)stats.turn.count(), stats.calls);
+    else
+        printf("%7.1fs %9llu %8llu %8llu %10.1f %10.1f %8.3fms %8.3fms %9llu %8llu %8llu %8llu %7llu\n",
+            seconds, stats.connected, stats.in_game, stats.rounds,
+            stats.messages_in / seconds, stats.messages_out / seconds, p50, p99,
+            failures, stats.rejects, stats.timeouts,
+            (unsigned long long)stats.turn.count(), stats.calls);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-a") && i + 1 < argc)
+            opts.address = argv[++i];
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            opts.port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            opts.bots = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+            opts.seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            opts.call_chance = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t"))
+            opts.tsv = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-a address] [-p port] [-n bots] [-d seconds]"
+                " [-c percent] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    asio::io_context context;
+    protocol::endpoint const endpoint(asio::ip::make_address(opts.address), opts.port);
+    statistics stats;
+
+    for (int i = 0; i < opts.bots; ++i)
+        std::make_shared<bot>(context, endpoint, opts, stats, i + 1)->start();
+
+    auto const start = clock_type::now();
+    asio::steady_timer ticker(context);
+    int elapsed = 0;
+    std::function<void(asio::error_code)> tick = [&](asio::error_code) {
+        ++elapsed;
+        print(stats, elapsed, elapsed == 1, opts.tsv);
+        if (elapsed >= opts.seconds)
+        {
+            context.stop();
+            return;
+        }
+        ticker.expires_at(start + std::chrono::seconds(elapsed + 1));
+        ticker.async_wait(tick);
+    };
+    ticker.expires_at(start + std::chrono::seconds(1));
+    ticker.async_wait(tick);
+
+    context.run();
+
+    if (!opts.tsv)
+        stats.turn.report(std::cout, "turn");
+    return stats.connect_failures + stats.disconnects ? EXIT_FAILURE : EXIT_SUCCESS;
+}
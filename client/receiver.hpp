@@ -3,19 +3,40 @@
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
+#include <algorithm>
 #include <thread>
 #include <condition_variable>
+#include <memory>
+#include <optional>
+#include <vector>
 #include "utils/message.hpp"
+#include "utils/shm.hpp"
 
 /**
  * @brief An interface to safely send and receive messages from the server,
  * as well as responding to occasional server pings.
+ *
+ * @details A client on the same machine as the server may use a shared memory
+ * link (see utils/shm.hpp) instead of the socket, which then only holds the
+ * session. The link is set up before the id is given to the user, so the
+ * messages of the user all go through it.
+ *
+ * Messages are read from the socket as they come, many per read: the I/O
+ * thread parses every whole message of a read where it was read, answers the
+ * pings, and hands the others to the user in one batch with one wakeup. The
+ * user then takes the messages of the batch without locking.
+ *
+ * Many receivers may share the I/O thread of one context, so one process
+ * hosts many clients.
  */
 class R
 {
 public:
     using protocol = asio::ip::tcp;
     using message_type = msg::buffer;
+
+    /* The bytes a read may take, many messages of a burst */
+    static constexpr std::size_t READ_SIZE = 4096;
 public:
     /**
      * @brief Construct a new receiver object
@@ -28,10 +49,13 @@ public:
      *
      * @param ip The IP address of the server.
      * @param port The port to connect to.
+     * @param shared_memory Use a shared memory link, the server must be on
+     * this machine.
      */
     template <typename IPType>
-    R(IPType ip, unsigned short port)
-        : server_endpoint(ip, port), socket(context)
+    R(IPType ip, unsigned short port, bool shared_memory = false)
+        : own_context(std::make_unique<asio::io_context>()), context(*own_context),
+          server_endpoint(ip, port), socket(context), wants_link(shared_memory)
     {
         try
         {
@@ -47,6 +71,25 @@ public:
         t_recv.detach();
     }
 
+    /**
+     * @brief Construct a receiver reading on the I/O thread of a context
+     * shared with other receivers.
+     *
+     * @details This constructor will block until the connection is
+     * established, then the receiver reads whenever the context runs, and
+     * must outlive its runs. There is no shared memory link. When the
+     * connection is closed, recv throws instead of exiting the process.
+     *
+     * @throws std::system_error If the connection fails.
+     */
+    template <typename IPType>
+    R(asio::io_context &io, IPType ip, unsigned short port)
+        : context(io), server_endpoint(ip, port), socket(context), wants_link(false)
+    {
+        socket.connect(server_endpoint);
+        async_recv();
+    }
+
     /**
      * @brief Send a message to the server with no data.
      *
@@ -54,8 +97,7 @@ public:
      */
     void send(msg::header header)
     {
-        socket.send(asio::buffer(msg::buffer_data(
-            header, msg::NO_INFO), msg::BUFFER_SIZE));
+        write(msg::buffer_data(header, msg::NO_INFO));
     }
 
     /**
@@ -69,7 +111,7 @@ public:
     template<typename ObjType>
     void send(msg::header header, ObjType obj)
     {
-        socket.send(asio::buffer(msg::buffer_data(header, obj), msg::BUFFER_SIZE));
+        write(msg::buffer_data(header, obj));
     }
 
     /**
@@ -77,12 +119,23 @@ public:
      *
      * @return The message that was received. Will wait until a message is
      * received.
+     *
+     * @throws std::system_error If the connection of a receiver on a shared
+     * context was closed, once its messages are taken.
      */
     message_type recv()
     {
-        std::unique_lock ul(m);
-        cv.wait(ul, [this]{ return !q.empty(); });
-        return q.pop_front();
+        if (taken == batch.size())
+        {
+            batch.clear();
+            taken = 0;
+            std::unique_lock ul(m);
+            cv.wait(ul, [this]{ return !q.empty() || closed; });
+            if (q.empty())
+                throw std::system_error(std::make_error_code(std::errc::connection_reset));
+            q.swap(batch);
+        }
+        return batch[taken++];
     }
 
     /**
@@ -105,44 +158,230 @@ public:
     /**
      * @return true if there is data available to be read, false otherwise.
      */
-    bool inline available() const noexcept { return !q.empty(); }
+    bool available() const
+    {
+        if (taken < batch.size())
+            return true;
+        std::scoped_lock lock(m);
+        return !q.empty();
+    }
 
     bool inline is_open() const noexcept { return socket.is_open(); }
 
 private:
-    asio::io_context context;
+    std::unique_ptr<asio::io_context> own_context;
+    asio::io_context &context;
     protocol::endpoint server_endpoint;
     protocol::socket socket;
 
     std::condition_variable cv;
+    mutable std::mutex m;
+
+    /* The messages received and not handed to the user yet (m) */
+    std::vector<message_type> q;
+    /* The connection of a shared context was closed (m) */
+    bool closed = false;
+
+    /* The messages handed to the user, taken up to taken (user) */
+    std::vector<message_type> batch;
+    std::size_t taken = 0;
+
+    /* The bytes read and not parsed yet, a message cut by the read (I/O) */
+    std::array<char, READ_SIZE> in;
+    std::size_t in_size = 0;
+
+    std::thread t_recv;
+
+    bool wants_link;
+    std::optional<shm::link> link;
+    /* The user and the ping replies both write to the link */
+    std::mutex link_m;
 
     /**
-     * @brief Fetch a message that was received from the server.
-     *
-     * @param header The header of the message.
-     * @param pos The position of the player who sent the message.
+     * Send a message through the link if there is one, waiting for room like
+     * a blocking send, or through the socket.
+     */
+    void write(msg::buffer const &buf)
+    {
+        if (link)
+        {
+            std::scoped_lock lock(link_m);
+            while (!link->send(buf) && link->is_open())
+                std::this_thread::yield();
+            return;
+        }
+        socket.send(asio::buffer(buf, msg::BUFFER_SIZE));
+    }
+
+    /**
+     * Ask the server for a link, after the id was received and before it is
+     * given to the user. The server tells which of its workers takes the link.
      *
-     * @return The message that was received. Will wait until a message is
-     * received.
+     * @return If the link was set up.
      */
-    std::mutex m;
+    bool set_up_link(msg::buffer const &your_id)
+    {
+        socket.send(asio::buffer(msg::buffer_data(
+            msg::header::shared_memory, msg::NO_INFO), msg::BUFFER_SIZE));
+        msg::buffer reply;
+        asio::read(socket, asio::buffer(reply, msg::BUFFER_SIZE));
+        if (msg::type(reply) != msg::header::shared_memory)
+            return false;
 
-    msg::queue<message_type> q { cv };
+        auto created = shm::link::create();
+        if (!created)
+            return false;
 
-    std::thread t_recv;
+        sockaddr_un addr;
+        socklen_t const length = shm::address(server_endpoint.port(),
+            msg::data<unsigned short>(reply), addr);
+        auto const id = msg::data<unsigned short>(your_id);
+        int const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool const sent = fd >= 0
+            && ::connect(fd, reinterpret_cast<sockaddr *>(&addr), length) == 0
+            && shm::send_handles(fd, created->fds(), &id, sizeof id);
+        if (fd >= 0)
+            ::close(fd);
+        if (sent)
+            link = std::move(created);
+        return sent;
+    }
+
+    /**
+     * Receive the next message, from the link or the socket.
+     */
+    msg::buffer read_message()
+    {
+        if (link)
+        {
+            /* The socket is only readable when the server left */
+            if (auto buf = link->recv(socket.native_handle()))
+                return *buf;
+            throw std::system_error(std::make_error_code(std::errc::connection_reset));
+        }
+        msg::buffer buf;
+        /* A burst from the server may be split anywhere */
+        asio::read(socket, asio::buffer(buf, msg::BUFFER_SIZE));
+        return buf;
+    }
+
+    /**
+     * Hand messages to the user, waking them once.
+     */
+    void deliver(message_type const *first, std::size_t count)
+    {
+        if (!count)
+            return;
+        {
+            std::scoped_lock lock(m);
+            q.insert(q.end(), first, first + count);
+        }
+        cv.notify_one();
+    }
+
+    /**
+     * Answer a ping without blocking the I/O thread, which other receivers
+     * may share. A failed write is seen by the next read.
+     */
+    void reply(message_type const &ping)
+    {
+        auto buf = std::make_shared<message_type>(ping);
+        asio::async_write(socket, asio::buffer(*buf, msg::BUFFER_SIZE),
+            [buf](asio::error_code, std::size_t) {});
+    }
+
+    /**
+     * Parse the whole messages read, answering the pings and delivering the
+     * others, and keep the cut one for the next read.
+     */
+    void parse()
+    {
+        std::array<message_type, READ_SIZE / msg::BUFFER_SIZE> received;
+        std::size_t count = 0, pos = 0;
+        for (; pos + msg::BUFFER_SIZE <= in_size; pos += msg::BUFFER_SIZE)
+        {
+            auto &cur_msg = received[count];
+            std::copy_n(in.begin() + pos, msg::BUFFER_SIZE, cur_msg.begin());
+            if (msg::type(cur_msg) == msg::header::ping)
+                reply(cur_msg);
+            else
+                ++count;
+        }
+        deliver(received.data(), count);
+
+        std::copy(in.begin() + pos, in.begin() + in_size, in.begin());
+        in_size -= pos;
+    }
+
+    /**
+     * Read whatever the server sent, then parse it and read again, until the
+     * connection is closed. Only the receiver is closed on a shared context.
+     */
+    void async_recv()
+    {
+        socket.async_read_some(asio::buffer(in.data() + in_size, READ_SIZE - in_size),
+            [this](asio::error_code ec, std::size_t length) {
+                if (ec && own_context)
+                {
+                    std::cerr << "Connection to the server closed\n" << std::endl;
+                    exit(EXIT_SUCCESS);
+                }
+                if (ec)
+                {
+                    asio::error_code ignored;
+                    socket.close(ignored);
+                    {
+                        std::scoped_lock lock(m);
+                        closed = true;
+                    }
+                    cv.notify_all();
+                    return;
+                }
+                in_size += length;
+                parse();
+                async_recv();
+            });
+    }
 
     /**
      * Continuously receive messages from the server and put them in the queue
-     * until the connection is closed.
+     * until the connection is closed. The socket is read asynchronously on
+     * this thread, the link is polled.
      */
     void recv_impl()
     {
+        try
+        {
+            if (wants_link)
+            {
+                auto your_id = read_message();
+                if (!set_up_link(your_id))
+                {
+                    std::cerr << "Failed to set up the shared memory link" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                deliver(&your_id, 1);
+            }
+        }
+        catch (std::system_error &e)
+        {
+            std::cerr << "Connection to the server closed\n" << std::endl;
+            exit(EXIT_SUCCESS);
+        }
+
+        if (!link)
+        {
+            async_recv();
+            context.run();
+            return;
+        }
+
         while(socket.is_open())
         {
             msg::buffer cur_msg;
             try
             {
-                socket.receive(asio::buffer(cur_msg, msg::BUFFER_SIZE));
+                cur_msg = read_message();
             }
             catch (std::system_error &e)
             {
@@ -150,9 +389,9 @@ private:
                 exit(EXIT_SUCCESS);
             }
             if (msg::type(cur_msg) == msg::header::ping)
-                socket.send(asio::buffer(cur_msg, msg::BUFFER_SIZE));
+                write(cur_msg);
             else
-                q.push_back(std::move(cur_msg));
+                deliver(&cur_msg, 1);
         }
     }
 };
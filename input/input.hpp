@@ -41,7 +41,12 @@ private:
 
 namespace input_3d
 {
+using input_2d::istream;
+using input_2d::trigger_render;
+
 void on_mouse_button(GLFWwindow *window, int button, int action, int mods);
+
+void on_key(GLFWwindow *window, int key, int scancode, int action, int mods);
 }
 
 #endif
@@ -0,0 +1,78 @@
+#include "renderer/3d.hpp"
+#include "input.hpp"
+
+#include <iostream>
+
+static constexpr float
+    CAMERA_STEP     = 0.5f,
+    CAMERA_TURN     = 0.05f;
+
+void input_3d::on_mouse_button(GLFWwindow *window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
+        istream::buffer("p");
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    if (int tile = renderer3d::hand_tile_at(x, y))
+    {
+        std::cout << "Clicked on tile at " << tile << std::endl;
+        istream::buffer(std::to_string(tile));
+    }
+}
+
+/*
+ * The calls have no buttons on the table, so they are keys: R ron, T tsumo,
+ * Q riichi, K kong, P pong, C chow and space to pass. WASD and the arrows
+ * move the camera.
+ */
+void input_3d::on_key(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    if (action == GLFW_RELEASE)
+        return;
+
+    camera &eye = renderer3d::view();
+    switch (key)
+    {
+    case GLFW_KEY_W:        eye.translate(CAMERA_STEP, 0.f, 0.f);   return;
+    case GLFW_KEY_S:        eye.translate(-CAMERA_STEP, 0.f, 0.f);  return;
+    case GLFW_KEY_D:        eye.translate(0.f, 0.f, CAMERA_STEP);   return;
+    case GLFW_KEY_A:        eye.translate(0.f, 0.f, -CAMERA_STEP);  return;
+    case GLFW_KEY_UP:       eye.rotate(CAMERA_TURN, 0.f);           return;
+    case GLFW_KEY_DOWN:     eye.rotate(-CAMERA_TURN, 0.f);          return;
+    case GLFW_KEY_LEFT:     eye.rotate(0.f, CAMERA_TURN);           return;
+    case GLFW_KEY_RIGHT:    eye.rotate(0.f, -CAMERA_TURN);          return;
+    }
+
+    if (action != GLFW_PRESS)
+        return;
+    switch (key)
+    {
+    case GLFW_KEY_ESCAPE:
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+        break;
+    case GLFW_KEY_R:
+        istream::buffer("R");
+        break;
+    case GLFW_KEY_T:
+        istream::buffer("T");
+        break;
+    case GLFW_KEY_Q:
+        istream::buffer("r");
+        break;
+    case GLFW_KEY_K:
+        istream::buffer("K");
+        break;
+    case GLFW_KEY_P:
+        istream::buffer("P");
+        break;
+    case GLFW_KEY_C:
+        istream::buffer("c");
+        break;
+    case GLFW_KEY_SPACE:
+        istream::buffer("p");
+        break;
+    }
+}
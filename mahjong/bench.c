@@ -0,0 +1,408 @@
+#define _DEBUG_LEVEL 0
+#define _POSIX_C_SOURCE 199309L
+
+#include "mahjong.h"
+#include "yaku.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Microbenchmark of the mahjong library over a seeded corpus of hands.
+ *
+ * Usage: BenchMahjong [-s seed] [-n hands] [-i iterations] [-t]
+ *
+ * Every (category, operation) is timed over all the hands of the category.
+ * -t prints tab separated values instead of the table, which can be diffed
+ * across commits. The result column is the sum of what the operation
+ * returned, so it only changes if the behaviour of the library does.
+ * The cycles of mj_score are then split between the search of the
+ * decompositions and their scoring, both read in the same run (a comment
+ * line with -t).
+ *
+ * Allocations are counted by wrapping malloc and realloc at link time
+ * (-Wl,--wrap=malloc,--wrap=realloc). Cycles are read from the time stamp
+ * counter, and are 0 where there is none.
+ */
+
+#define MAX_HANDS 4096
+#define TRIPLE_CAPACITY 4096
+#define MAX_RESULTS 32
+
+/* Allocation counter */
+
+static unsigned long long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    ++allocations;
+    return __real_malloc(size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    return __real_realloc(ptr, size);
+}
+
+/* Clocks */
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Corpus */
+
+static unsigned long long rng_state;
+
+/* xorshift64*, so the corpus only depends on the seed */
+static unsigned rng(unsigned bound)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 0x2545f4914f6cdd1dULL) >> 32) % bound;
+}
+
+typedef struct bench_hand
+{
+    mj_hand hand;       /* sorted, 14 tiles with the melds */
+    mj_meld melds;
+    mj_tile ron;        /* also the tile removed for mj_tenpai */
+    mj_bool tsumo;
+} bench_hand;
+
+typedef struct bench_category
+{
+    char const *name;
+    void (*generate)(bench_hand *);
+    bench_hand *hands;  /* MAX_HANDS of them, size generated */
+    mj_size size;
+} bench_category;
+
+static int kind_count[MJ_UNIQUE_TILES];
+
+static mj_tile draw_kind(int kind)
+{
+    int suit = kind < 27 ? kind / 9 : (kind < 31 ? MJ_WIND : MJ_DRAGON);
+    int number = kind < 27 ? kind % 9 : (kind < 31 ? kind - 27 : kind - 31);
+    return MJ_TILE(suit, number, kind_count[kind]++);
+}
+
+static int random_kind(int suit)
+{
+    return suit < 0 ? (int)rng(MJ_UNIQUE_TILES) : suit * 9 + (int)rng(9);
+}
+
+/* Four triples and a pair, the first open ones are melds. suit < 0 for any
+ * suit. */
+static void complete_hand(bench_hand *h, int suit, mj_size open)
+{
+    mj_triple triple;
+    memset(kind_count, 0, sizeof(kind_count));
+    memset(h, 0, sizeof(*h));
+
+    while (h->hand.size + 3 * h->melds.size < MJ_MAX_HAND_SIZE - 2)
+    {
+        int kind = random_kind(suit);
+        if (kind < 27 && kind % 9 < 7 && rng(2))
+        {
+            if (kind_count[kind] > 3 || kind_count[kind+1] > 3 || kind_count[kind+2] > 3)
+                continue;
+            triple = MJ_TRIPLE(draw_kind(kind), draw_kind(kind+1), draw_kind(kind+2));
+        }
+        else
+        {
+            if (kind_count[kind] > 1)
+                continue;
+            triple = MJ_TRIPLE(draw_kind(kind), draw_kind(kind), draw_kind(kind));
+        }
+
+        if (h->melds.size < open)
+        {
+            h->melds.melds[h->melds.size++] = MJ_OPEN_TRIPLE(triple);
+        }
+        else
+        {
+            h->hand.tiles[h->hand.size++] = MJ_FIRST(triple);
+            h->hand.tiles[h->hand.size++] = MJ_SECOND(triple);
+            h->hand.tiles[h->hand.size++] = MJ_THIRD(triple);
+        }
+    }
+
+    int kind;
+    do kind = random_kind(suit); while (kind_count[kind] > 2);
+    h->hand.tiles[h->hand.size++] = draw_kind(kind);
+    h->hand.tiles[h->hand.size++] = draw_kind(kind);
+
+    mj_sort_hand(&h->hand);
+    h->ron = h->hand.tiles[rng(h->hand.size)];
+    h->tsumo = rng(2) ? MJ_TRUE : MJ_FALSE;
+}
+
+static void generate_random(bench_hand *h)
+{
+    memset(kind_count, 0, sizeof(kind_count));
+    memset(h, 0, sizeof(*h));
+    while (h->hand.size < MJ_MAX_HAND_SIZE)
+    {
+        int kind = random_kind(-1);
+        if (kind_count[kind] < 4)
+            h->hand.tiles[h->hand.size++] = draw_kind(kind);
+    }
+    mj_sort_hand(&h->hand);
+    h->ron = h->hand.tiles[rng(h->hand.size)];
+    h->tsumo = rng(2) ? MJ_TRUE : MJ_FALSE;
+}
+
+/* A complete hand with one tile swapped, so that it is tenpai without the
+ * new tile */
+static void generate_tenpai(bench_hand *h)
+{
+    complete_hand(h, -1, 0);
+
+    int kind;
+    do kind = random_kind(-1); while (kind_count[kind] > 3);
+    h->ron = draw_kind(kind);
+    h->hand.tiles[rng(h->hand.size)] = h->ron;
+    mj_sort_hand(&h->hand);
+}
+
+static void generate_complete(bench_hand *h)
+{
+    complete_hand(h, -1, 0);
+}
+
+static void generate_chinitsu(bench_hand *h)
+{
+    complete_hand(h, (int)rng(3), 0);
+}
+
+static void generate_open(bench_hand *h)
+{
+    complete_hand(h, -1, 1 + rng(3));
+}
+
+#define NUM_CATEGORIES 5
+
+static bench_hand corpus[NUM_CATEGORIES][MAX_HANDS];
+
+static bench_category categories[NUM_CATEGORIES] = {
+    {"random", generate_random, corpus[0], 0},
+    {"tenpai", generate_tenpai, corpus[1], 0},
+    {"complete", generate_complete, corpus[2], 0},
+    {"chinitsu", generate_chinitsu, corpus[3], 0},
+    {"open", generate_open, corpus[4], 0},
+};
+
+/* Operations */
+
+static long long op_triples(bench_hand const *h)
+{
+    static mj_triple triples[TRIPLE_CAPACITY];
+    return mj_triples(h->hand, triples, TRIPLE_CAPACITY);
+}
+
+static long long op_agari(bench_hand const *h)
+{
+    mj_meld result[MAX_RESULTS];
+    mj_pair pairs[MAX_RESULTS];
+    return mj_n_agari(h->hand, h->melds, result, pairs);
+}
+
+static long long op_tenpai(bench_hand const *h)
+{
+    mj_hand waiting;
+    mj_id waits[MJ_UNIQUE_TILES];
+    waiting.size = 0;
+    for (mj_size i = 0; i < h->hand.size; ++i)
+    {
+        if (h->hand.tiles[i] != h->ron)
+            waiting.tiles[waiting.size++] = h->hand.tiles[i];
+    }
+    return mj_tenpai(waiting, h->melds, waits);
+}
+
+static long long op_score(bench_hand const *h)
+{
+    unsigned short yakus[MJ_YAKU_ARR_SIZE];
+    int fu = 0, fan = 0;
+    memset(yakus, 0, sizeof(yakus));
+    yakus[MJ_YAKU_RICHII] = h->melds.size == 0;
+    int basic = mj_score(&fu, &fan, yakus, &h->hand, &h->melds, h->ron, h->tsumo, MJ_EAST, MJ_SOUTH);
+    return basic + fu + fan;
+}
+
+typedef struct bench_op
+{
+    char const *name;
+    long long (*run)(bench_hand const *);
+} bench_op;
+
+static bench_op const ops[] = {
+    {"mj_triples", op_triples},
+    {"mj_n_agari", op_agari},
+    {"mj_tenpai", op_tenpai},
+    {"mj_score", op_score},
+};
+
+typedef struct bench_result
+{
+    double ns;
+    double cycles;
+    double allocs;
+    long long result;
+} bench_result;
+
+static bench_result run_op(bench_op const *op, bench_category const *cat, int iterations)
+{
+    bench_result res = {0, 0, 0, 0};
+
+    for (mj_size i = 0; i < cat->size; ++i) /* warm up, and the result */
+        res.result += op->run(cat->hands + i);
+
+    unsigned long long const allocs = allocations;
+    unsigned long long const cycles = now_cycles();
+    double const start = now_ns();
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (mj_size i = 0; i < cat->size; ++i)
+            op->run(cat->hands + i);
+    }
+
+    double const n = (double)iterations * cat->size;
+    res.ns = (now_ns() - start) / n;
+    res.cycles = (now_cycles() - cycles) / n;
+    res.allocs = (allocations - allocs) / n;
+    return res;
+}
+
+/*
+ * The cycles of mj_score split between its two phases, read in the same run:
+ * the search of the decompositions (mj_n_agari), and their fu and fan, as
+ * mj_score does them. The reads of the counter are counted in the phases.
+ */
+static void score_breakdown(bench_category const *cat, int iterations,
+    double *agari_cycles, double *scoring_cycles)
+{
+    mj_meld result[MAX_RESULTS];
+    mj_pair pairs[MAX_RESULTS];
+    unsigned short yakus[MJ_YAKU_ARR_SIZE];
+    unsigned long long agari = 0, scoring = 0;
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (mj_size i = 0; i < cat->size; ++i)
+        {
+            bench_hand const *h = cat->hands + i;
+            unsigned long long const start = now_cycles();
+            mj_size const n = mj_n_agari(h->hand, h->melds, result, pairs);
+            unsigned long long const searched = now_cycles();
+
+            for (mj_size d = 0; d < n; ++d)
+            {
+                memset(yakus, 0, sizeof(yakus));
+                yakus[MJ_YAKU_RICHII] = h->melds.size == 0;
+                int const fu = mj_fu(yakus, result+d, pairs[d], h->ron, h->tsumo, MJ_EAST, MJ_SOUTH);
+                int const fan = mj_fan(yakus, result+d, pairs[d], MJ_EAST, MJ_SOUTH);
+                mj_basic_score(fu, fan);
+            }
+
+            agari += searched - start;
+            scoring += now_cycles() - searched;
+        }
+    }
+
+    double const n = (double)iterations * cat->size;
+    *agari_cycles = agari / n;
+    *scoring_cycles = scoring / n;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long seed = 1;
+    int hands = 200, iterations = 10, tsv = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            hands = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t"))
+            tsv = 1;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s seed] [-n hands] [-i iterations] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (hands < 1 || hands > MAX_HANDS || iterations < 1)
+    {
+        fprintf(stderr, "hands must be in [1, %d] and iterations positive\n", MAX_HANDS);
+        return 1;
+    }
+
+    rng_state = seed ? seed : 1;
+    for (size_t c = 0; c < sizeof(categories) / sizeof(*categories); ++c)
+    {
+        categories[c].size = hands;
+        for (int i = 0; i < hands; ++i)
+            categories[c].generate(categories[c].hands + i);
+    }
+
+    if (tsv)
+        printf("# seed=%llu hands=%d iterations=%d\n"
+            "category\top\tns_per_op\tcycles_per_op\tallocs_per_op\tresult\n",
+            seed, hands, iterations);
+    else
+        printf("seed %llu, %d hands per category, %d iterations\n\n"
+            "%-10s %-20s %12s %12s %10s %12s\n",
+            seed, hands, iterations, "category", "op", "ns/op", "cycles/op", "allocs/op", "result");
+
+    for (size_t c = 0; c < sizeof(categories) / sizeof(*categories); ++c)
+    {
+        for (size_t o = 0; o < sizeof(ops) / sizeof(*ops); ++o)
+        {
+            bench_result res = run_op(ops + o, categories + c, iterations);
+            printf(tsv ? "%s\t%s\t%.1f\t%.1f\t%.2f\t%lld\n" : "%-10s %-20s %12.1f %12.1f %10.2f %12lld\n",
+                categories[c].name, ops[o].name, res.ns, res.cycles, res.allocs, res.result);
+        }
+
+        double agari_cycles, scoring_cycles;
+        score_breakdown(categories + c, iterations, &agari_cycles, &scoring_cycles);
+        double const total = agari_cycles + scoring_cycles;
+        if (tsv)
+            printf("# %s\tmj_score_cycles\tmj_n_agari=%.1f\tfu_fan=%.1f\n",
+                categories[c].name, agari_cycles, scoring_cycles);
+        else if (total > 0)
+            printf("%-10s mj_score cycles: %.0f%% mj_n_agari, %.0f%% fu and fan\n\n", "",
+                100 * agari_cycles / total, 100 * scoring_cycles / total);
+        else
+            printf("\n");
+    }
+
+    return 0;
+}
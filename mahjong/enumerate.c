@@ -0,0 +1,504 @@
+#define _DEBUG_LEVEL 0
+#define _POSIX_C_SOURCE 200809L
+
+#include "mahjong.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Exhaustive enumeration of closed hands, run through the reference
+ * mj_n_agari and mj_tenpai.
+ *
+ * Usage: EnumerateMahjong [-m suit|hands] [-k kinds] [-n tiles] [-j threads]
+ *                         [-c checkpoint] [-o table]
+ *
+ * suit (default): every pattern of one suit with at most 14 tiles (405350
+ *   patterns). The rest of the hand is filled with honor melds (and an honor
+ *   pair if the pattern has 3n tiles), so that the value of a pattern is:
+ *   - 3n+1 tiles: the bitmask of the numbers (0-8) it waits on.
+ *   - 3n, 3n+2 tiles: the number of decompositions of the pattern.
+ *   The values are written to the table file (-o, suit_table.bin) as a header
+ *   "MJSUIT1\0", uint32 entries, uint32 0, then one uint16 per pattern,
+ *   indexed by the counts of the numbers in base 5 (number 0 is the lowest
+ *   digit).
+ *
+ * hands: every closed hand of 13 or 14 tiles (-n) over the first kinds
+ *   (-k, by MJ_ID_34). 14 tiles are decomposed and 13 tiles are checked for
+ *   tenpai. Only the statistics are kept. All 34 kinds is ~3e11 hands, so
+ *   a full sweep takes many runs of the checkpoint.
+ *
+ * The counts of the last kinds split the space into work units, that the
+ * threads take in turn. Finished units are appended to the checkpoint file
+ * (-c) with their statistics, and a run with the same checkpoint and options
+ * skips them. The statistics of all the units are printed as key=value lines
+ * at the end.
+ */
+
+#define MAX_UNIT_KINDS 5
+#define MAX_DECOMPOSITIONS 64
+#define TABLE_MAGIC "MJSUIT1"
+#define TABLE_HEADER_SIZE 16
+
+typedef struct enum_stats
+{
+    unsigned long long hands;
+    unsigned long long wins;            /* hands with a decomposition */
+    unsigned long long decompositions;
+    unsigned long long tenpai;
+    unsigned long long waits;
+    unsigned long long decomposition_hist[MAX_DECOMPOSITIONS + 1];
+    unsigned long long wait_hist[MJ_UNIQUE_TILES + 1];
+} enum_stats;
+
+typedef struct enum_unit
+{
+    int counts[MJ_UNIQUE_TILES];
+    enum_stats stats;
+    unsigned short *values;             /* suit mode only */
+    mj_meld result[MAX_DECOMPOSITIONS];
+    mj_pair pairs[MAX_DECOMPOSITIONS];
+} enum_unit;
+
+static struct
+{
+    int suit_mode;
+    int kinds;
+    int min_tiles, max_tiles;
+    int unit_kinds;                     /* kinds fixed by a unit (the last ones) */
+    unsigned units;
+    unsigned unit_size;                 /* 5^(kinds-unit_kinds), suit mode only */
+} config;
+
+static atomic_uint next_unit;
+static atomic_uint units_done;
+static atomic_ullong hands_done;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *checkpoint;
+static int table_fd = -1;
+static unsigned char *finished;
+static enum_stats total;
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static mj_tile tile_of_kind(int kind, int sub)
+{
+    if (kind < 27)
+        return MJ_TILE(kind / 9, kind % 9, sub);
+    if (kind < 31)
+        return MJ_TILE(MJ_WIND, kind - 27, sub);
+    return MJ_TILE(MJ_DRAGON, kind - 31, sub);
+}
+
+static void build_hand(int const *counts, mj_hand *hand)
+{
+    hand->size = 0;
+    for (int kind = 0; kind < config.kinds; ++kind)
+    {
+        for (int sub = 0; sub < counts[kind]; ++sub)
+            hand->tiles[hand->size++] = tile_of_kind(kind, sub);
+    }
+}
+
+static void stats_merge(enum_stats *dst, enum_stats const *src)
+{
+    unsigned long long *d = (unsigned long long *)dst;
+    unsigned long long const *s = (unsigned long long const *)src;
+    for (size_t i = 0; i < sizeof(enum_stats) / sizeof(*d); ++i)
+        d[i] += s[i];
+}
+
+static void count_agari(enum_unit *unit, mj_size n)
+{
+    unit->stats.wins += n > 0;
+    unit->stats.decompositions += n;
+    ++unit->stats.decomposition_hist[n < MAX_DECOMPOSITIONS ? n : MAX_DECOMPOSITIONS];
+}
+
+static void count_tenpai(enum_unit *unit, mj_size n)
+{
+    unit->stats.tenpai += n > 0;
+    unit->stats.waits += n;
+    ++unit->stats.wait_hist[n];
+}
+
+static unsigned short visit_suit(enum_unit *unit, int tiles)
+{
+    mj_hand hand;
+    mj_meld melds;
+    mj_id waits[MJ_UNIQUE_TILES];
+    build_hand(unit->counts, &hand);
+
+    /* honor pongs for the triples the pattern does not have */
+    melds.size = 0;
+    for (int wind = tiles / 3; wind < MJ_MAX_TRIPLES_IN_HAND; ++wind)
+    {
+        melds.melds[melds.size++] = MJ_OPEN_TRIPLE(MJ_TRIPLE(MJ_TILE(MJ_WIND, wind, 0),
+            MJ_TILE(MJ_WIND, wind, 1), MJ_TILE(MJ_WIND, wind, 2)));
+    }
+
+    if (tiles % 3 == 1)
+    {
+        mj_size n = mj_tenpai(hand, melds, waits);
+        unsigned short mask = 0;
+        for (mj_size i = 0; i < n; ++i)
+            mask |= 1 << (waits[i] & 0xf);
+        count_tenpai(unit, n);
+        return mask;
+    }
+
+    if (tiles % 3 == 0)
+    {
+        hand.tiles[hand.size++] = MJ_TILE(MJ_DRAGON, 0, 0);
+        hand.tiles[hand.size++] = MJ_TILE(MJ_DRAGON, 0, 1);
+    }
+    mj_size n = mj_n_agari(hand, melds, unit->result, unit->pairs);
+    count_agari(unit, n);
+    return n;
+}
+
+static void visit_hand(enum_unit *unit, int tiles)
+{
+    mj_hand hand;
+    mj_meld melds;
+    melds.size = 0;
+    build_hand(unit->counts, &hand);
+
+    if (tiles == MJ_MAX_HAND_SIZE)
+        count_agari(unit, mj_n_agari(hand, melds, unit->result, unit->pairs));
+    else
+        count_tenpai(unit, mj_tenpai(hand, melds, NULL));
+}
+
+/* All the counts of the kinds before the ones fixed by the unit */
+static void enumerate(enum_unit *unit, int kind, int tiles, unsigned offset, unsigned place)
+{
+    int const free_kinds = config.kinds - config.unit_kinds;
+    if (kind == free_kinds)
+    {
+        if (tiles < config.min_tiles)
+            return;
+        ++unit->stats.hands;
+        if (config.suit_mode)
+            unit->values[offset] = visit_suit(unit, tiles);
+        else
+            visit_hand(unit, tiles);
+        return;
+    }
+    if (tiles + 4 * (free_kinds - kind) < config.min_tiles)
+        return;
+
+    for (int c = 0; c <= 4 && tiles + c <= config.max_tiles; ++c)
+    {
+        unit->counts[kind] = c;
+        enumerate(unit, kind + 1, tiles + c, offset + c * place, place * 5);
+    }
+    unit->counts[kind] = 0;
+}
+
+static void write_checkpoint(unsigned index, enum_stats const *stats)
+{
+    unsigned long long const *s = (unsigned long long const *)stats;
+    fprintf(checkpoint, "%u", index);
+    for (size_t i = 0; i < sizeof(enum_stats) / sizeof(*s); ++i)
+        fprintf(checkpoint, " %llu", s[i]);
+    fputc('\n', checkpoint);
+    fflush(checkpoint);
+}
+
+static void *worker(void *arg)
+{
+    (void)arg;
+    enum_unit *unit = (enum_unit *)calloc(1, sizeof(enum_unit));
+    if (config.suit_mode)
+        unit->values = (unsigned short *)malloc(sizeof(unsigned short) * config.unit_size);
+
+    for (;;)
+    {
+        unsigned const index = atomic_fetch_add(&next_unit, 1);
+        if (index >= config.units)
+            break;
+        if (finished[index])
+            continue;
+
+        memset(&unit->stats, 0, sizeof(unit->stats));
+        int tiles = 0;
+        for (int i = 0, rest = index; i < config.unit_kinds; ++i, rest /= 5)
+        {
+            unit->counts[config.kinds - config.unit_kinds + i] = rest % 5;
+            tiles += rest % 5;
+        }
+
+        /* Every unit writes its values, the ones with too many tiles zeros */
+        if (config.suit_mode)
+            memset(unit->values, 0, sizeof(unsigned short) * config.unit_size);
+        if (tiles <= config.max_tiles)
+            enumerate(unit, 0, tiles, 0, 1);
+
+        /* the values of a unit are written before it is checkpointed */
+        if (config.suit_mode)
+        {
+            size_t const bytes = sizeof(unsigned short) * config.unit_size;
+            if (pwrite(table_fd, unit->values, bytes, TABLE_HEADER_SIZE + (off_t)index * bytes) != (ssize_t)bytes)
+            {
+                perror("pwrite");
+                exit(1);
+            }
+        }
+
+        pthread_mutex_lock(&lock);
+        stats_merge(&total, &unit->stats);
+        if (checkpoint)
+            write_checkpoint(index, &unit->stats);
+        pthread_mutex_unlock(&lock);
+
+        atomic_fetch_add(&hands_done, unit->stats.hands);
+        atomic_fetch_add(&units_done, 1);
+    }
+
+    free(unit->values);
+    free(unit);
+    return NULL;
+}
+
+/* Returns the number of units already finished, or -1 on a mismatch */
+static int resume(char const *path, char const *header)
+{
+    char line[4096];
+    int restored = 0;
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    if (!fgets(line, sizeof(line), file) || strcmp(line, header))
+    {
+        fclose(file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char *cur = line, *end;
+        unsigned long index = strtoul(cur, &end, 10);
+        if (end == cur || index >= config.units)
+            break;
+
+        enum_stats stats;
+        unsigned long long *s = (unsigned long long *)&stats;
+        size_t i = 0;
+        for (cur = end; i < sizeof(enum_stats) / sizeof(*s); ++i, cur = end)
+        {
+            s[i] = strtoull(cur, &end, 10);
+            if (end == cur)
+                break;
+        }
+        if (i < sizeof(enum_stats) / sizeof(*s)) /* cut off by a kill */
+            break;
+
+        if (!finished[index])
+        {
+            finished[index] = 1;
+            stats_merge(&total, &stats);
+            ++restored;
+        }
+    }
+    fclose(file);
+    return restored;
+}
+
+/* Write the header of a new table, or check that the table of a resumed run
+ * was written with the same options and is complete */
+static int open_table(char const *path, int resumed)
+{
+    unsigned char header[TABLE_HEADER_SIZE] = TABLE_MAGIC;
+    unsigned const entries = config.units * config.unit_size;
+    off_t const size = TABLE_HEADER_SIZE + sizeof(unsigned short) * (off_t)entries;
+    memcpy(header + 8, &entries, sizeof(entries));
+
+    /* A resumed table must exist, a new one would have no values */
+    table_fd = open(path, resumed ? O_RDWR : O_RDWR | O_CREAT, 0644);
+    if (table_fd < 0)
+    {
+        perror(path);
+        return 0;
+    }
+
+    if (resumed)
+    {
+        unsigned char found[TABLE_HEADER_SIZE];
+        struct stat st;
+        if (pread(table_fd, found, sizeof(found), 0) != sizeof(found) ||
+            memcmp(found, header, sizeof(header)) || fstat(table_fd, &st) || st.st_size != size)
+        {
+            fprintf(stderr, "%s was not written with these options, cannot resume\n", path);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (ftruncate(table_fd, 0) || pwrite(table_fd, header, sizeof(header), 0) != sizeof(header) ||
+        ftruncate(table_fd, size))
+    {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+static void print_stats(double seconds, int threads, unsigned long long hands)
+{
+    printf("mode=%s\nkinds=%d\ntiles=%d-%d\nthreads=%d\nseconds=%.2f\nhands_per_second=%.0f\n",
+        config.suit_mode ? "suit" : "hands", config.kinds, config.min_tiles, config.max_tiles,
+        threads, seconds, seconds > 0 ? hands / seconds : 0);
+    printf("hands=%llu\nwins=%llu\ndecompositions=%llu\ntenpai=%llu\nwaits=%llu\n",
+        total.hands, total.wins, total.decompositions, total.tenpai, total.waits);
+    for (int i = 1; i <= MAX_DECOMPOSITIONS; ++i)
+    {
+        if (total.decomposition_hist[i])
+            printf("decompositions_%d=%llu\n", i, total.decomposition_hist[i]);
+    }
+    for (int i = 1; i <= MJ_UNIQUE_TILES; ++i)
+    {
+        if (total.wait_hist[i])
+            printf("waits_%d=%llu\n", i, total.wait_hist[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char const *checkpoint_path = NULL, *table_path = "suit_table.bin";
+    int tiles = MJ_MAX_HAND_SIZE, threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    config.suit_mode = 1;
+    config.kinds = MJ_UNIQUE_TILES;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            config.suit_mode = strcmp(argv[++i], "hands") != 0;
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+            config.kinds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            tiles = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            checkpoint_path = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            table_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-m suit|hands] [-k kinds] [-n tiles] [-j threads] "
+                "[-c checkpoint] [-o table]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.suit_mode)
+    {
+        config.kinds = 9;
+        config.min_tiles = 0;
+        config.max_tiles = MJ_MAX_HAND_SIZE;
+    }
+    else if (config.kinds < 2 || config.kinds > MJ_UNIQUE_TILES ||
+        (tiles != MJ_MAX_HAND_SIZE && tiles != MJ_MAX_HAND_SIZE - 1))
+    {
+        fprintf(stderr, "kinds must be in [2, %d] and tiles 13 or 14\n", MJ_UNIQUE_TILES);
+        return 1;
+    }
+    else
+    {
+        config.min_tiles = config.max_tiles = tiles;
+    }
+    if (threads < 1)
+        threads = 1;
+
+    config.unit_kinds = config.kinds - 1 < MAX_UNIT_KINDS ? config.kinds - 1 : MAX_UNIT_KINDS;
+    config.units = 1;
+    for (int i = 0; i < config.unit_kinds; ++i)
+        config.units *= 5;
+    config.unit_size = 1;
+    for (int i = config.unit_kinds; i < config.kinds; ++i)
+        config.unit_size *= 5;
+    finished = (unsigned char *)calloc(config.units, 1);
+
+    char header[128];
+    snprintf(header, sizeof(header), "# mode=%s kinds=%d tiles=%d-%d units=%u\n",
+        config.suit_mode ? "suit" : "hands", config.kinds, config.min_tiles, config.max_tiles,
+        config.units);
+
+    int resumed = 0;
+    if (checkpoint_path)
+    {
+        resumed = resume(checkpoint_path, header);
+        if (resumed < 0)
+        {
+            fprintf(stderr, "%s was written with other options\n", checkpoint_path);
+            return 1;
+        }
+        checkpoint = fopen(checkpoint_path, resumed ? "a" : "w");
+        if (!checkpoint)
+        {
+            perror(checkpoint_path);
+            return 1;
+        }
+        if (!resumed)
+            fputs(header, checkpoint);
+        else
+            fprintf(stderr, "resuming, %d of %u units done\n", resumed, config.units);
+    }
+    if (config.suit_mode && !open_table(table_path, resumed))
+        return 1;
+
+    pthread_t *pool = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    double const start = now_s();
+    for (int i = 0; i < threads; ++i)
+        pthread_create(pool + i, NULL, worker, NULL);
+
+    /* throughput report */
+    unsigned const todo = config.units - resumed;
+    int const tty = isatty(STDERR_FILENO);
+    double last_report = start;
+    while (atomic_load(&units_done) < todo)
+    {
+        struct timespec const tick = {0, 100000000};
+        nanosleep(&tick, NULL);
+
+        double const now = now_s();
+        if (now - last_report < (tty ? 1 : 10))
+            continue;
+        last_report = now;
+
+        unsigned const done = atomic_load(&units_done);
+        unsigned long long const hands = atomic_load(&hands_done);
+        double const rate = hands / (now - start);
+        fprintf(stderr, "%s%u/%u units, %llu hands, %.0f hands/s, eta %.0fs%s",
+            tty ? "\r" : "", done + resumed, config.units, hands, rate,
+            done ? (now - start) * (todo - done) / done : 0.0, tty ? "" : "\n");
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(pool[i], NULL);
+    if (tty)
+        fputc('\n', stderr);
+
+    print_stats(now_s() - start, threads, atomic_load(&hands_done));
+
+    if (checkpoint)
+        fclose(checkpoint);
+    if (table_fd >= 0)
+        close(table_fd);
+    free(pool);
+    free(finished);
+    return 0;
+}
@@ -1,11 +1,72 @@
 #include "interaction.h"
 #include <string.h>
 
+/**
+ * A run can be completed on a kind if the hand holds the two kinds below it,
+ * the two kinds above it, or one on each side (all in the same suit).
+ */
+static inline mj_mask chow_mask(mj_mask single_mask)
+{
+    mj_mask const h = single_mask & MJ_MASK_SUITED;
+    return ((h >> 1) & (h >> 2) & MJ_MASK_NUM_0_6) |
+           ((h << 1) & (h >> 1) & MJ_MASK_NUM_1_7) |
+           ((h << 1) & (h << 2) & MJ_MASK_NUM_2_8);
+}
+
+/* The count of each kind is stored in unary over the four masks */
+static inline void mask_add(mj_hand *hand, mj_tile tile)
+{
+    if (tile == MJ_INVALID_TILE)
+        return;
+
+    mj_mask const bit = MJ_KIND_BIT(tile);
+    if (hand->kong_mask & bit)
+        hand->quad_mask |= bit;
+    else if (hand->pong_mask & bit)
+        hand->kong_mask |= bit;
+    else if (hand->single_mask & bit)
+        hand->pong_mask |= bit;
+    else
+    {
+        hand->single_mask |= bit;
+        hand->chow_mask = chow_mask(hand->single_mask);
+    }
+}
+
+static inline void mask_remove(mj_hand *hand, mj_tile tile)
+{
+    if (tile == MJ_INVALID_TILE)
+        return;
+
+    mj_mask const bit = MJ_KIND_BIT(tile);
+    if (hand->quad_mask & bit)
+        hand->quad_mask &= ~bit;
+    else if (hand->kong_mask & bit)
+        hand->kong_mask &= ~bit;
+    else if (hand->pong_mask & bit)
+        hand->pong_mask &= ~bit;
+    else
+    {
+        hand->single_mask &= ~bit;
+        hand->chow_mask = chow_mask(hand->single_mask);
+    }
+}
+
 void mj_empty_hand(mj_hand *hand)
 {
     hand->size = 0;
     for (mj_tile *i = hand->tiles; i < hand->tiles + MJ_MAX_HAND_SIZE; ++i)
         *i = MJ_INVALID_TILE;
+    hand->single_mask = hand->pong_mask = hand->kong_mask =
+        hand->quad_mask = hand->chow_mask = 0;
+}
+
+void mj_update_masks(mj_hand *hand)
+{
+    hand->single_mask = hand->pong_mask = hand->kong_mask =
+        hand->quad_mask = hand->chow_mask = 0;
+    for (mj_tile *i = hand->tiles; i < hand->tiles + hand->size; ++i)
+        mask_add(hand, *i);
 }
 
 void mj_add_tile(mj_hand *hand, mj_tile tile)
@@ -14,6 +75,7 @@ void mj_add_tile(mj_hand *hand, mj_tile tile)
         return;
     hand->tiles[hand->size++] = tile;
     mj_sort_hand(hand);
+    mask_add(hand, tile);
 }
 
 mj_bool mj_discard_tile(mj_hand *hand, mj_tile tile)
@@ -25,6 +87,7 @@ mj_bool mj_discard_tile(mj_hand *hand, mj_tile tile)
             *i = MJ_INVALID_TILE;
             mj_sort_hand(hand);
             --hand->size;
+            mask_remove(hand, tile);
             return MJ_TRUE;
         }
     }
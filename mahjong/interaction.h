@@ -15,6 +15,15 @@ extern "C" {
  */
 void mj_empty_hand(mj_hand *hand);
 
+/**
+ * @brief Recompute the call masks of a hand from its tiles. Only needed when
+ * the tiles were written directly (i.e. with mj_parse), since the other
+ * functions in this header keep the masks up to date.
+ *
+ * @param hand The hand to update.
+ */
+void mj_update_masks(mj_hand *hand);
+
 /**
  * @brief Add a tile to the player's hand.
  *
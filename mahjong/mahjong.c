@@ -2,9 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_CAPACITY 512
+#define MAX_CAPACITY 4096
 #define TRIPLE_BUFFER_SIZE 64
-#define PAIR_BUFFER_SIZE 16
+#define PAIR_BUFFER_SIZE 64
 
 void mj_parse(char const *str, mj_hand *hand)
 {
@@ -155,9 +155,10 @@ static mj_size mj_traverse_tree(mj_tile *hand, mj_size begin, mj_size size, mj_t
             return 0;
 
     hand[i++] = MJ_INVALID_TILE;
-    for (; hand[i] != MJ_THIRD(branch); ++i)
-        if (i == size)
-            return 0;
+    for (; i < size && hand[i] != MJ_THIRD(branch); ++i)
+        ;
+    if (i == size) /* do not read past the end, it holds stale tiles */
+        return 0;
 
     hand[i++] = MJ_INVALID_TILE;
 
@@ -223,8 +224,31 @@ static mj_hand_array *dfs(mj_tile *tiles, mj_size size, mj_triple *triples, mj_s
 
     mj_hand_array *children = NULL;
 
+    /* If the triples must use every tile (as for agari), the lowest tile left
+     * must be the first tile of the next triple. The triples are ordered by
+     * their first tile, so no branch after those can use it. */
+    mj_tile lowest = MJ_INVALID_TILE;
+    mj_size tiles_left = 0;
+    for (mj_size i = 0; i < size; ++i)
+    {
+        if (tiles[i] != MJ_INVALID_TILE)
+        {
+            if (!tiles_left++)
+                lowest = tiles[i];
+        }
+    }
+    if (tiles_left != 3 * n)
+        lowest = MJ_INVALID_TILE;
+
     for (mj_size i = 0; i <= num_triples - n; ++i)
     {
+        if (lowest != MJ_INVALID_TILE && MJ_FIRST(triples[i]) != lowest)
+        {
+            if (MJ_FIRST(triples[i]) > lowest)
+                break;
+            continue;
+        }
+
         mj_tile tmp_tiles[MJ_MAX_HAND_SIZE];
         mj_size tmp_size = clean_hand(tiles, size, tmp_tiles);
         mj_size next = mj_traverse_tree(tmp_tiles, 0, tmp_size, triples[i]);
@@ -317,7 +341,7 @@ mj_size mj_n_triples(mj_hand hand, mj_triple *triples, mj_size num_triples, mj_t
     }
 
     /* Now we remove all winds and dragons from the hand, start at the end of the array */
-    while(MJ_SUIT(hand.tiles[hand.size - 1])==MJ_WIND || MJ_SUIT(hand.tiles[hand.size - 1])==MJ_DRAGON)
+    while(hand.size && (MJ_SUIT(hand.tiles[hand.size - 1])==MJ_WIND || MJ_SUIT(hand.tiles[hand.size - 1])==MJ_DRAGON))
     {
         --hand.size;
     }
@@ -437,103 +461,197 @@ mj_size mj_tenpai(mj_hand hand, mj_meld o_melds, mj_id *result)
     mj_size num_waiting = 0;
     mj_hand tmp_hand;
 
-    mj_size idx = 0; /* index that allows us to march through the hand exactly once */
-
-    /* check the tiles of each normal suit */
-    for (int suit = MJ_CHARACTER; ; ++suit)
+    /* Only the kinds in the hand, and the suited kinds next to them, can
+     * complete it. */
+    int counts[MJ_UNIQUE_TILES] = {0};
+    mj_mask kinds = 0;
+    for (mj_size i = 0; i < hand.size; ++i)
     {
-        while (MJ_SUIT(hand.tiles[idx]) != suit)
-        {
-            if (MJ_SUIT(hand.tiles[idx]) > suit)
-                ++suit;
-            if (MJ_SUIT(hand.tiles[idx]) < suit)
-                ++idx;
-        }
-
-        if (suit > MJ_BAMBOO)
-            break;
-
-        /* suit >= tilesuit */
-        for (int number = 0; number < 9; ++number)
-        {
-            while ((MJ_SUIT(hand.tiles[idx]) == suit &&
-                MJ_NUMBER(hand.tiles[idx]) < number - 1) ||
-                MJ_NUMBER(hand.tiles[idx]) > number + 1)
-            {
-                if (MJ_NUMBER(hand.tiles[idx]) < number - 1)
-                    ++idx;
-                if (MJ_NUMBER(hand.tiles[idx]) > number + 1)
-                    ++number;
-            }
-            if (MJ_SUIT(hand.tiles[idx]) != suit)
-                break;
-
-            memcpy(&tmp_hand, &hand, sizeof(tmp_hand));
-            tmp_hand.tiles[tmp_hand.size++] = MJ_TILE(suit, number, 0);
-            mj_sort_hand(&tmp_hand);
-            mj_size num_wins = mj_n_agari(tmp_hand, o_melds, triples, pairs);
-            if (num_wins)
-            {
-                if (result)
-                    result[num_waiting] = MJ_128_TILE(suit, number);
-                ++num_waiting;
-            }
-        }
+        kinds |= MJ_KIND_BIT(hand.tiles[i]);
+        ++counts[MJ_ID_34(hand.tiles[i])];
     }
-
-    /* check honor tiles */
-    for (int number = 0; ; ++number)
+    for (mj_size i = 0; i < o_melds.size; ++i)
     {
-        while (MJ_SUIT(hand.tiles[idx]) == MJ_WIND &&
-            MJ_NUMBER(hand.tiles[idx]) != number)
-        {
-            if (MJ_NUMBER(hand.tiles[idx]) < number)
-                ++idx;
-            if (MJ_NUMBER(hand.tiles[idx]) > number)
-                ++number;
-        }
-        if (number >= 4 || MJ_SUIT(hand.tiles[idx]) != MJ_WIND)
-            break;
-
-        memcpy(&tmp_hand, &hand, sizeof(mj_hand));
-        tmp_hand.tiles[tmp_hand.size++] = MJ_TILE(MJ_WIND, number, 0);
-        mj_sort_hand(&tmp_hand);
-        mj_size num_wins = mj_n_agari(tmp_hand, o_melds, triples, pairs);
-        if (num_wins)
-        {
-            if (result)
-                result[num_waiting] = MJ_128_TILE(MJ_WIND, number);
-            ++num_waiting;
-        }
+        mj_triple const meld = o_melds.melds[i];
+        ++counts[MJ_ID_34(MJ_FIRST(meld))];
+        ++counts[MJ_ID_34(MJ_SECOND(meld))];
+        counts[MJ_ID_34(MJ_THIRD(meld))] += MJ_IS_KONG(meld) ? 2 : 1;
     }
+    mj_mask const suited = kinds & MJ_MASK_SUITED;
+    kinds |= (suited << 1) & (MJ_MASK_NUM_1_7 | MJ_MASK_NUM_2_8);
+    kinds |= (suited >> 1) & (MJ_MASK_NUM_0_6 | MJ_MASK_NUM_1_7);
 
-    for (int number = 0; ; ++number)
+    for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
     {
-        while (MJ_SUIT(hand.tiles[idx]) == MJ_DRAGON &&
-            MJ_NUMBER(hand.tiles[idx]) != number)
+        /* there is no fifth tile to win with */
+        if (!(kinds & (mj_mask)1 << kind) || counts[kind] >= 4)
+            continue;
+
+        int suit = kind < 27 ? kind / 9 : (kind < 31 ? MJ_WIND : MJ_DRAGON);
+        int number = kind < 27 ? kind % 9 : (kind < 31 ? kind - 27 : kind - 31);
+
+        /* use a copy of the tile that is not in the hand */
+        mj_tile tile = MJ_TILE(suit, number, 0);
+        for (mj_size i = 0; i < hand.size; ++i)
         {
-            if (MJ_NUMBER(hand.tiles[idx]) < number)
-                ++number;
-            if (MJ_NUMBER(hand.tiles[idx]) > number)
-                ++idx;
+            if (hand.tiles[i] == tile)
+                ++tile;
         }
-        if (number >= 3 || MJ_SUIT(hand.tiles[idx]) != MJ_DRAGON)
-            break;
 
         memcpy(&tmp_hand, &hand, sizeof(tmp_hand));
-        tmp_hand.tiles[tmp_hand.size++] = MJ_TILE(MJ_DRAGON, number, 0);
+        tmp_hand.tiles[tmp_hand.size++] = tile;
         mj_sort_hand(&tmp_hand);
         mj_size num_wins = mj_n_agari(tmp_hand, o_melds, triples, pairs);
         if (num_wins)
         {
             if (result)
-                result[num_waiting] = MJ_128_TILE(MJ_DRAGON, number);
+                result[num_waiting] = MJ_128_TILE(suit, number);
             ++num_waiting;
         }
     }
     return num_waiting;
 }
 
+/* The kinds held by a hand and its melds, a kong counting four */
+static void count_kinds(mj_hand const *hand, mj_meld const *o_melds, int *counts)
+{
+    memset(counts, 0, MJ_UNIQUE_TILES * sizeof(int));
+    for (mj_size i = 0; i < hand->size; ++i)
+        ++counts[MJ_ID_34(hand->tiles[i])];
+    for (mj_size i = 0; i < o_melds->size; ++i)
+    {
+        mj_triple const meld = o_melds->melds[i];
+        ++counts[MJ_ID_34(MJ_FIRST(meld))];
+        ++counts[MJ_ID_34(MJ_SECOND(meld))];
+        counts[MJ_ID_34(MJ_THIRD(meld))] += MJ_IS_KONG(meld) ? 2 : 1;
+    }
+}
+
+/*
+ * Depth first over the kinds left from the lowest, taking a set, a pair, a
+ * partial set (two tiles of a set) or dropping a tile, and keeping the lowest
+ * shanten of the regular hand found. left is the number of tiles left.
+ */
+static void regular_shanten(int *counts, int kind, int left, int sets, int partials, int pair,
+    int *best)
+{
+    while (kind < MJ_UNIQUE_TILES && !counts[kind])
+        ++kind;
+
+    /* A partial set beyond the fourth set cannot become one */
+    int const counted = sets + partials < MJ_MAX_TRIPLES_IN_HAND ?
+        partials : MJ_MAX_TRIPLES_IN_HAND - sets;
+    int const shanten = 8 - 2*sets - counted - pair;
+    if (kind == MJ_UNIQUE_TILES)
+    {
+        if (shanten < *best)
+            *best = shanten;
+        return;
+    }
+
+    /* The tiles left lower it by 2 per set of 3 at most, and only by the
+     * sets and the pair still missing */
+    int gain = 2 * (MJ_MAX_TRIPLES_IN_HAND - sets - counted) + !pair;
+    if (gain > 2 * left / 3)
+        gain = 2 * left / 3;
+    if (shanten - gain >= *best)
+        return;
+
+    int const runs = kind < 27 && kind % 9 < 7, sides = kind < 27 && kind % 9 < 8;
+
+    if (counts[kind] >= 3)
+    {
+        counts[kind] -= 3;
+        regular_shanten(counts, kind, left - 3, sets + 1, partials, pair, best);
+        counts[kind] += 3;
+    }
+    if (runs && counts[kind + 1] && counts[kind + 2])
+    {
+        --counts[kind]; --counts[kind + 1]; --counts[kind + 2];
+        regular_shanten(counts, kind, left - 3, sets + 1, partials, pair, best);
+        ++counts[kind]; ++counts[kind + 1]; ++counts[kind + 2];
+    }
+    if (counts[kind] >= 2)
+    {
+        counts[kind] -= 2;
+        if (!pair)
+            regular_shanten(counts, kind, left - 2, sets, partials, 1, best);
+        regular_shanten(counts, kind, left - 2, sets, partials + 1, pair, best);
+        counts[kind] += 2;
+    }
+    if (sides && counts[kind + 1])
+    {
+        --counts[kind]; --counts[kind + 1];
+        regular_shanten(counts, kind, left - 2, sets, partials + 1, pair, best);
+        ++counts[kind]; ++counts[kind + 1];
+    }
+    if (runs && counts[kind + 2])
+    {
+        --counts[kind]; --counts[kind + 2];
+        regular_shanten(counts, kind, left - 2, sets, partials + 1, pair, best);
+        ++counts[kind]; ++counts[kind + 2];
+    }
+
+    --counts[kind];
+    regular_shanten(counts, kind, left - 1, sets, partials, pair, best);
+    ++counts[kind];
+}
+
+int mj_shanten(mj_hand hand, mj_meld o_melds)
+{
+    int counts[MJ_UNIQUE_TILES] = {0};
+    for (mj_size i = 0; i < hand.size; ++i)
+        ++counts[MJ_ID_34(hand.tiles[i])];
+
+    int best = 8 - 2*o_melds.size;
+    regular_shanten(counts, 0, hand.size, o_melds.size, 0, 0, &best);
+    if (o_melds.size || hand.size < MJ_MAX_HAND_SIZE - 1)
+        return best;
+
+    int kinds = 0, pairs = 0, orphans = 0, orphan_pair = 0;
+    for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
+    {
+        int const orphan = kind >= 27 || kind % 9 == 0 || kind % 9 == 8;
+        kinds += counts[kind] > 0;
+        pairs += counts[kind] > 1;
+        orphans += orphan && counts[kind];
+        orphan_pair |= orphan && counts[kind] > 1;
+    }
+
+    int const seven_pairs = 6 - pairs + (kinds < 7 ? 7 - kinds : 0);
+    int const orphans_shanten = 13 - orphans - orphan_pair;
+    if (seven_pairs < best)
+        best = seven_pairs;
+    if (orphans_shanten < best)
+        best = orphans_shanten;
+    return best;
+}
+
+mj_mask mj_ukeire(mj_hand hand, mj_meld o_melds)
+{
+    if (hand.size >= MJ_MAX_HAND_SIZE)
+        return 0;
+
+    int counts[MJ_UNIQUE_TILES];
+    count_kinds(&hand, &o_melds, counts);
+    int const shanten = mj_shanten(hand, o_melds);
+
+    mj_mask accepted = 0;
+    ++hand.size;
+    for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
+    {
+        if (counts[kind] >= 4)
+            continue;
+
+        int const suit = kind < 27 ? kind / 9 : (kind < 31 ? MJ_WIND : MJ_DRAGON);
+        int const number = kind < 27 ? kind % 9 : (kind < 31 ? kind - 27 : kind - 31);
+        hand.tiles[hand.size - 1] = MJ_TILE(suit, number, 0);
+        if (mj_shanten(hand, o_melds) < shanten)
+            accepted |= (mj_mask)1 << kind;
+    }
+    return accepted;
+}
+
 void mj_print_tile(mj_tile tile)
 {
 #if _DEBUG_LEVEL > 0
@@ -43,11 +43,19 @@ typedef unsigned int mj_pair;
 typedef unsigned int mj_triple;
 /* Size (size_t is too wide) */
 typedef unsigned short mj_size;
+/* Set of tile kinds, one bit per MJ_ID_34 (34 bits) */
+typedef unsigned long long mj_mask;
 /* Mahjong hand */
 #define MJ_MAX_HAND_SIZE 14
 typedef struct mj_hand {
     mj_tile tiles[MJ_MAX_HAND_SIZE];
     mj_size size;
+    /* The masks are only kept up to date by the functions in interaction.h */
+    mj_mask single_mask;    /* kinds held at least once */
+    mj_mask pong_mask;      /* kinds held at least twice (can PONG) */
+    mj_mask kong_mask;      /* kinds held at least three times (can KONG) */
+    mj_mask quad_mask;      /* kinds held four times (can closed KONG) */
+    mj_mask chow_mask;      /* kinds that complete a run with two held tiles */
 } mj_hand;
 /* Melds */
 #define MJ_MAX_TRIPLES_IN_HAND 4
@@ -84,6 +92,12 @@ typedef struct mj_meld {
 
 #define MJ_INVALID_TILE     (mj_tile)(-1)
 
+/* Masks of the tile kinds (MJ_ID_34) with the number in a range */
+#define MJ_MASK_SUITED      (mj_mask)0x7ffffff
+#define MJ_MASK_NUM_0_6     (mj_mask)(0x7f|0x7f<<9|0x7f<<18)
+#define MJ_MASK_NUM_1_7     (mj_mask)(0xfe|0xfe<<9|0xfe<<18)
+#define MJ_MASK_NUM_2_8     (mj_mask)(0x1fc|0x1fc<<9|0x1fc<<18)
+
 /* Player change */
 #define MJ_NEXT_PLAYER(p)   (((p) + 1) & 3)
 
@@ -114,6 +128,13 @@ typedef struct mj_meld {
 #define MJ_ID_128(x) \
 (mj_id)(((x)>>2) & 0x7f)
 
+/* Dense index from 0 to 33 of the kind of tile (also works on melds) */
+#define MJ_ID_34(x) \
+(mj_id)(MJ_SUIT(x)*9 + MJ_NUMBER(x) - (MJ_SUIT(x)==MJ_DRAGON ? 5 : 0))
+
+#define MJ_KIND_BIT(x) \
+((mj_mask)1 << MJ_ID_34(x))
+
 /* Number gets the number of the first tile in the meld */
 #define MJ_NUMBER(x) \
 (((x)>>2) & 0b1111)
@@ -254,6 +275,30 @@ mj_size mj_n_agari(mj_hand hand, mj_meld o_melds, mj_meld *m_result, mj_pair *p_
  */
 mj_size mj_tenpai(mj_hand hand, mj_meld o_melds, mj_id *result);
 
+/**
+ * @brief Count how many tiles a hand is away from tenpai.
+ *
+ * @details The smallest of the shanten of a regular hand (4 sets and a pair),
+ * of seven pairs and of thirteen orphans, the last two only for a closed hand.
+ * The hand does not need to be sorted, and may hold the drawn tile.
+ *
+ * @param hand The hand to check.
+ * @param o_melds The open melds the player has called.
+ * @return The shanten, 0 for a tenpai hand and -1 for a winning hand.
+ */
+int mj_shanten(mj_hand hand, mj_meld o_melds);
+
+/**
+ * @brief Find the tiles that bring a hand closer to tenpai (the ukeire).
+ *
+ * @param hand The hand to check, without the drawn tile.
+ * @param o_melds The open melds the player has called.
+ * @return The kinds that lower the shanten of the hand when drawn, of which
+ * the hand and the melds do not already hold four. For a tenpai hand, the
+ * kinds it wins with.
+ */
+mj_mask mj_ukeire(mj_hand hand, mj_meld o_melds);
+
 void mj_print_tile(mj_tile tile);
 void mj_print_pair(mj_pair pair);
 void mj_print_triple(mj_triple triple);
@@ -157,6 +157,80 @@ static void test_chow(char const *hand_str, mj_tile chow_tile, mj_size chows)
     assert(mj_chow_available(hand, chow_tile, NULL) == chows);
 }
 
+static mj_tile tile_of_kind(int kind)
+{
+    if (kind < 27)
+        return MJ_TILE(kind / 9, kind % 9, 0);
+    if (kind < 31)
+        return MJ_TILE(MJ_WIND, kind - 27, 0);
+    return MJ_TILE(MJ_DRAGON, kind - 31, 0);
+}
+
+static void check_masks(mj_hand const *hand)
+{
+    for (int kind = 0; kind < MJ_UNIQUE_TILES; ++kind)
+    {
+        mj_tile tile = tile_of_kind(kind);
+        mj_mask bit = (mj_mask)1 << kind;
+        assert(MJ_ID_34(tile) == kind);
+        assert(!(hand->pong_mask & bit) == !mj_pong_available(*hand, tile, NULL));
+        assert(!(hand->kong_mask & bit) == !mj_kong_available(*hand, tile, NULL));
+        assert(!(hand->quad_mask & bit) == !mj_closed_kong_available(*hand, tile));
+        assert(!(hand->chow_mask & bit) == !mj_chow_available(*hand, tile, NULL));
+    }
+}
+
+static void test_masks(char const *hand_str)
+{
+    mj_hand parsed, hand;
+    mj_parse(hand_str, &parsed);
+    mj_empty_hand(&hand);
+    for (mj_size i = 0; i < parsed.size; ++i)
+    {
+        mj_add_tile(&hand, parsed.tiles[i]);
+        check_masks(&hand);
+    }
+
+    mj_update_masks(&parsed);
+    assert(parsed.chow_mask == hand.chow_mask && parsed.quad_mask == hand.quad_mask);
+
+    while (hand.size)
+    {
+        mj_bool discarded = mj_discard_tile(&hand, hand.tiles[hand.size / 2]);
+        assert(discarded);
+        check_masks(&hand);
+    }
+    assert(!hand.single_mask && !hand.chow_mask);
+}
+
+static void test_score(int expected_score, int expected_fu, int expected_fan,
+    char const *hand_str, int tile_idx, mj_bool tsumo, int riichi)
+{
+    mj_hand hand;
+    mj_meld empty = {0,0,0,0,0};
+    unsigned short yakus[MJ_YAKU_ARR_SIZE];
+    int fu = 0, fan = 0;
+    mj_parse(hand_str, &hand);
+
+    memset(yakus, 0, sizeof(yakus));
+    yakus[MJ_YAKU_RICHII] = riichi;
+
+    mj_tile ron = hand.tiles[tile_idx];
+    int score = mj_score(&fu, &fan, yakus, &hand, &empty, ron, tsumo, MJ_EAST, MJ_SOUTH);
+    assert(score == expected_score);
+    assert(fu == expected_fu && fan == expected_fan);
+}
+
+static void test_shanten(char const *hand_str, int shanten, mj_mask ukeire)
+{
+    mj_hand hand;
+    mj_meld empty = {0,0,0,0,0};
+    mj_parse(hand_str, &hand);
+    assert(mj_shanten(hand, empty) == shanten);
+    if (hand.size < MJ_MAX_HAND_SIZE)
+        assert(mj_ukeire(hand, empty) == ukeire);
+}
+
 int main(int argc, char *argv[])
 {
     mj_hand hand;
@@ -219,5 +293,22 @@ int main(int argc, char *argv[])
 
     test_chow("5m4678p1s112234w33d", MJ_TILE(MJ_CIRCLE, 4, 0), 2);
 
+    test_masks("12567m123456ps22wd");
+    test_masks("1111999m1289p9s123w");
+    test_masks("2467m1267p6s22w333d");
+    test_masks("m12345678999p1sw3d");
+
+    test_score(6000, 30, 11, "11112222333344mpswd", 0, MJ_FALSE, 0);
+    test_score(6000, 50, 12, "11122233344455mpswd", 4, MJ_TRUE, 1);
+    test_score(6000, 30, 13, "22334455667788mpswd", 7, MJ_FALSE, 1);
+    test_score(2000, 40, 4, "111122223333m55pswd", 13, MJ_TRUE, 0);
+
+    test_shanten("11122233344455mpswd", -1, 0);
+    test_shanten("23m456p789s111w22d", 0, 1ull << 0 | 1ull << 3);
+    test_shanten("19m456p789s111w22d", 1, 0x1c7 | 1ull << 32);
+    test_shanten("1133557799m11p3swd", 0, 1ull << 20);
+    test_shanten("19m19p19s1234w123d", 0, 0x3fc060301ull);
+    test_shanten("147m258p369s1234w1d", 6, 0);
+
     return 0;
 }
@@ -0,0 +1,278 @@
+/**
+ * Header only C++ layer over the tiles, triples, hands and melds of
+ * mahjong.h. The attributes of every tile are computed once, at compile time,
+ * in a table indexed by the 9 bits of the tile, so they cost one load instead
+ * of the shifts and compares of the macros.
+ */
+
+#ifndef MJ_MAHJONG_TILE_HPP
+#define MJ_MAHJONG_TILE_HPP
+
+#include "mahjong.h"
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <ranges>
+#include <span>
+
+namespace mj
+{
+
+/**
+ * @brief The kind of a tile (MJ_ID_34), from 0 to 33, ordered by suit then
+ * number.
+ */
+class kind
+{
+public:
+    constexpr kind() noexcept = default;
+    constexpr explicit kind(int index) noexcept : index_{static_cast<std::uint8_t>(index)} {}
+
+    constexpr int index() const noexcept { return index_; }
+    constexpr mj_mask bit() const noexcept { return mj_mask{1} << index_; }
+
+    constexpr int suit() const noexcept
+    {
+        return index_ < 27 ? index_ / 9 : (index_ < 31 ? MJ_WIND : MJ_DRAGON);
+    }
+    constexpr int number() const noexcept
+    {
+        return index_ < 27 ? index_ % 9 : (index_ < 31 ? index_ - 27 : index_ - 31);
+    }
+    /* The ID (128) used by mj_tenpai, mj_pairs and the server */
+    constexpr mj_id id_128() const noexcept { return MJ_128_TILE(suit(), number()); }
+
+    constexpr auto operator<=>(kind const &) const noexcept = default;
+
+private:
+    std::uint8_t index_ = 0;
+};
+
+namespace detail
+{
+
+struct tile_attributes
+{
+    std::uint8_t kind;
+    std::uint8_t dora;      /* kind that is dora if this tile is the indicator */
+    bool terminal;          /* 1 or 9 of a suit */
+    bool honor;
+    bool green;             /* can be in ryuuiisou */
+};
+
+constexpr tile_attributes make_attributes(int tile)
+{
+    int const suit = MJ_SUIT(tile), number = MJ_NUMBER(tile);
+    tile_attributes a{};
+    if (suit < MJ_WIND)
+    {
+        a.kind = suit * 9 + number;
+        a.dora = suit * 9 + (number + 1) % 9;
+        a.terminal = number == 0 || number == 8;
+        a.green = suit == MJ_BAMBOO &&
+            (number == 1 || number == 2 || number == 3 || number == 5 || number == 7);
+    }
+    else if (suit == MJ_WIND)
+    {
+        a.kind = 27 + number;
+        a.dora = 27 + (number + 1) % 4;
+        a.honor = true;
+    }
+    else
+    {
+        a.kind = 31 + number;
+        a.dora = 31 + (number + 1) % 3;
+        a.honor = true;
+        a.green = number == MJ_GREEN;
+    }
+    return a;
+}
+
+/* Indexed by the 9 bits of a tile. Tiles outside the deck (and
+ * MJ_INVALID_TILE) are of kind MJ_UNIQUE_TILES, which equals no real kind. */
+inline constexpr auto TILE_ATTRIBUTES = []
+{
+    std::array<tile_attributes, 512> table{};
+    for (int tile = 0; tile < 512; ++tile)
+    {
+        if (MJ_SUIT(tile) <= MJ_DRAGON)
+            table[tile] = make_attributes(tile);
+        else
+            table[tile].kind = table[tile].dora = MJ_UNIQUE_TILES;
+    }
+    return table;
+}();
+
+} // namespace detail
+
+/**
+ * @brief A tile of the deck. Same layout as mj_tile.
+ */
+class tile
+{
+public:
+    constexpr tile() noexcept = default;
+    constexpr explicit tile(mj_tile value) noexcept : value_{value} {}
+    constexpr tile(int suit, int number, int sub = 0) noexcept
+        : value_{static_cast<mj_tile>(MJ_TILE(suit, number, sub))} {}
+
+    constexpr mj_tile raw() const noexcept { return value_; }
+    constexpr bool valid() const noexcept { return value_ != MJ_INVALID_TILE; }
+
+    constexpr int suit() const noexcept { return MJ_SUIT(value_); }
+    constexpr int number() const noexcept { return MJ_NUMBER(value_); }
+    constexpr int sub() const noexcept { return value_ & 3; }
+    constexpr mj_id id_128() const noexcept { return MJ_ID_128(value_); }
+
+    constexpr mj::kind kind() const noexcept { return mj::kind{attributes().kind}; }
+    constexpr bool terminal() const noexcept { return attributes().terminal; }
+    constexpr bool honor() const noexcept { return attributes().honor; }
+    /* MJ_IS_19 */
+    constexpr bool terminal_or_honor() const noexcept
+    {
+        return attributes().terminal || attributes().honor;
+    }
+    constexpr bool green() const noexcept { return attributes().green; }
+    /**
+     * @brief The kind that is dora when this tile is the indicator.
+     */
+    constexpr mj::kind dora() const noexcept { return mj::kind{attributes().dora}; }
+
+    constexpr auto operator<=>(tile const &) const noexcept = default;
+
+private:
+    constexpr detail::tile_attributes const &attributes() const noexcept
+    {
+        return detail::TILE_ATTRIBUTES[value_ & 0x1ff];
+    }
+
+    mj_tile value_ = MJ_INVALID_TILE;
+};
+
+/**
+ * @brief A set or run of three tiles (or a kong), open or closed. Same layout
+ * as mj_triple.
+ */
+class triple
+{
+public:
+    constexpr triple() noexcept = default;
+    constexpr explicit triple(mj_triple value) noexcept : value_{value} {}
+    constexpr triple(tile a, tile b, tile c) noexcept
+        : value_{MJ_TRIPLE(a.raw(), b.raw(), c.raw())} {}
+
+    constexpr mj_triple raw() const noexcept { return value_; }
+
+    constexpr tile first() const noexcept { return tile{MJ_FIRST(value_)}; }
+    constexpr tile second() const noexcept { return tile{MJ_SECOND(value_)}; }
+    constexpr tile third() const noexcept { return tile{MJ_THIRD(value_)}; }
+    /* Kind of the first tile */
+    constexpr mj::kind kind() const noexcept { return first().kind(); }
+
+    constexpr bool set() const noexcept { return MJ_IS_SET(value_); }
+    constexpr bool open() const noexcept { return MJ_IS_OPEN(value_); }
+    constexpr bool kong() const noexcept { return MJ_IS_KONG(value_); }
+    constexpr int called_from() const noexcept { return MJ_TRIPLE_FROM(value_); }
+    constexpr std::size_t tiles() const noexcept { return kong() ? 4 : 3; }
+
+    constexpr bool honor() const noexcept { return first().honor(); }
+    /* MJ_IS_19_MELD */
+    constexpr bool has_terminal_or_honor() const noexcept
+    {
+        return first().terminal_or_honor() || third().terminal_or_honor();
+    }
+
+    constexpr auto operator<=>(triple const &) const noexcept = default;
+
+private:
+    mj_triple value_ = 0;
+};
+
+/**
+ * @brief Read only view of the tiles of an mj_hand.
+ */
+class hand_view
+{
+public:
+    constexpr explicit hand_view(mj_hand const &hand) noexcept : hand_{&hand} {}
+
+    constexpr std::size_t size() const noexcept { return hand_->size; }
+    constexpr bool empty() const noexcept { return hand_->size == 0; }
+    constexpr tile operator[](std::size_t i) const noexcept { return tile{hand_->tiles[i]}; }
+
+    constexpr std::span<mj_tile const> raw() const noexcept
+    {
+        return {hand_->tiles, hand_->size};
+    }
+    constexpr auto tiles() const noexcept
+    {
+        return raw() | std::views::transform([](mj_tile t) { return tile{t}; });
+    }
+    constexpr auto begin() const noexcept { return tiles().begin(); }
+    constexpr auto end() const noexcept { return tiles().end(); }
+
+    constexpr int count(mj::kind k) const noexcept
+    {
+        int n = 0;
+        for (auto t : raw())
+            n += tile{t}.kind() == k;
+        return n;
+    }
+
+private:
+    mj_hand const *hand_;
+};
+
+/**
+ * @brief Read only view of the triples of an mj_meld.
+ */
+class meld_view
+{
+public:
+    constexpr explicit meld_view(mj_meld const &meld) noexcept : meld_{&meld} {}
+
+    constexpr std::size_t size() const noexcept { return meld_->size; }
+    constexpr bool empty() const noexcept { return meld_->size == 0; }
+    constexpr triple operator[](std::size_t i) const noexcept { return triple{meld_->melds[i]}; }
+
+    constexpr std::span<mj_triple const> raw() const noexcept
+    {
+        return {meld_->melds, meld_->size};
+    }
+    constexpr auto triples() const noexcept
+    {
+        return raw() | std::views::transform([](mj_triple t) { return triple{t}; });
+    }
+    constexpr auto begin() const noexcept { return triples().begin(); }
+    constexpr auto end() const noexcept { return triples().end(); }
+
+    /* Counts kongs as four tiles */
+    constexpr int count(mj::kind k) const noexcept
+    {
+        int n = 0;
+        for (auto t : triples())
+        {
+            if (t.kong())
+                n += t.kind() == k ? 4 : 0;
+            else
+                n += (t.first().kind() == k) + (t.second().kind() == k) + (t.third().kind() == k);
+        }
+        return n;
+    }
+
+private:
+    mj_meld const *meld_;
+};
+
+static_assert(sizeof(tile) == sizeof(mj_tile) && sizeof(triple) == sizeof(mj_triple));
+static_assert(tile{MJ_CHARACTER, 0}.kind().index() == 0 && tile{MJ_DRAGON, 2, 3}.kind().index() == 33);
+static_assert(tile{MJ_CIRCLE, 8}.dora() == tile{MJ_CIRCLE, 0}.kind());
+static_assert(tile{MJ_WIND, MJ_NORTH}.dora() == tile{MJ_WIND, MJ_EAST}.kind());
+static_assert(tile{MJ_DRAGON, MJ_WHITE}.dora() == tile{MJ_DRAGON, MJ_GREEN}.kind());
+static_assert(tile{MJ_BAMBOO, 5}.green() && !tile{MJ_BAMBOO, 4}.green());
+static_assert(kind{20}.id_128() == MJ_128_TILE(MJ_BAMBOO, 2));
+static_assert(tile{}.kind().index() == MJ_UNIQUE_TILES);
+
+} // namespace mj
+
+#endif
@@ -490,7 +490,7 @@ inline int mj_basic_score(int fu, int fan)
 int mj_score(int *fu, int *fan, unsigned short *yakus,
     mj_hand const *hand, mj_meld const *melds, mj_tile ron, mj_bool tsumo, int prevailing_wind, int seat_wind)
 {
-    mj_meld result[MAX_RESULTS*4];
+    mj_meld result[MAX_RESULTS];
     mj_pair pairs[MAX_RESULTS];
     unsigned short m_yakus[MJ_YAKU_ARR_SIZE];
     unsigned short best_yakus[MJ_YAKU_ARR_SIZE];
@@ -501,12 +501,14 @@ int mj_score(int *fu, int *fan, unsigned short *yakus,
     if (n == 0)
         return 0;
 
+    memcpy(best_yakus, yakus, sizeof(best_yakus));
+
     int m_score = 0;
     for (mj_size i = 0; i < n; ++i)
     {
         memcpy(m_yakus, yakus, sizeof(m_yakus));
-        int m_fu = mj_fu(m_yakus, result+(4*i), pairs[i], ron, tsumo, prevailing_wind, seat_wind);
-        int m_fan = mj_fan(m_yakus, result+(4*i), pairs[i], prevailing_wind, seat_wind);
+        int m_fu = mj_fu(m_yakus, result+i, pairs[i], ron, tsumo, prevailing_wind, seat_wind);
+        int m_fan = mj_fan(m_yakus, result+i, pairs[i], prevailing_wind, seat_wind);
 
         if (m_score < mj_basic_score(m_fu, m_fan+doras))
         {
@@ -523,7 +525,6 @@ int mj_score(int *fu, int *fan, unsigned short *yakus,
 }
 
 
-
 void mj_print_yaku(unsigned short const *yakus)
 {
 #if _DEBUG_LEVEL > 0
@@ -125,6 +125,22 @@ int mj_yakuman(unsigned short *yakus, mj_meld const *melds, mj_pair pair, mj_til
  */
 int mj_basic_score(int fu, int fan);
 
+/**
+ * @brief Find the decomposition of a winning hand with the highest basic
+ * score.
+ *
+ * @param fu The fu of the best decomposition. Unchanged if the score is 0.
+ * @param fan The fan of the best decomposition (without dora). Unchanged if
+ * the score is 0.
+ * @param yakus The external yakus and dora of the hand. Filled with the yakus
+ * of the best decomposition.
+ * @param hand The closed part of the hand. @pre must be sorted.
+ * @param melds The open melds (and closed kongs) of the hand.
+ * @param ron The tile the hand won on.
+ * @param tsumo Whether the hand is won by tsumo.
+ * @return The basic score of the hand, or 0 if it is not a winning hand or
+ * has no yaku.
+ */
 int mj_score(int *fu, int *fan, unsigned short *yakus,
     mj_hand const *hand, mj_meld const *melds, mj_tile ron, mj_bool tsumo,
     int prevailing_wind, int seat_wind);
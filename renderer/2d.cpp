@@ -1,6 +1,7 @@
 #include "2d.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 
@@ -39,6 +40,10 @@ renderer2d &renderer2d::get_instance()
 
 GLFWwindow *renderer2d::init_window()
 {
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
     if (!glfwInit())
         return nullptr;
 
@@ -48,6 +53,11 @@ GLFWwindow *renderer2d::init_window()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
     glfwWindowHint(GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+    if (headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
 
     GLFWwindow *new_window = glfwCreateWindow(
         WINDOW_WIDTH, WINDOW_HEIGHT, "Washizu Mahjong", nullptr, nullptr);
@@ -56,7 +66,7 @@ GLFWwindow *renderer2d::init_window()
         return nullptr;
 
     glfwMakeContextCurrent(new_window);
-    glfwSwapInterval(1);
+    glfwSwapInterval(headless ? 0 : 1);
 
     if (glewInit() != GLEW_OK)
         return nullptr;
@@ -77,53 +87,62 @@ renderer2d::renderer2d() : window(init_window())
     if (!window)
         throw std::runtime_error("Failed to initialize renderer2d window.");
 
-    buffer = buffer_ptr = new quad2d[MAX_QUADS];
-    glGenVertexArrays(1, &vao);
+    /* The format only, the buffers are attached by create_ring */
+    glCreateVertexArrays(1, &vao);
+    glVertexArrayAttribFormat(vao, 0, 2, GL_FLOAT, GL_FALSE, offsetof(vertex2d, position));
+    glVertexArrayAttribFormat(vao, 1, 4, GL_FLOAT, GL_FALSE, offsetof(vertex2d, tint));
+    glVertexArrayAttribFormat(vao, 2, 2, GL_FLOAT, GL_FALSE, offsetof(vertex2d, tex_coord));
+    glVertexArrayAttribFormat(vao, 3, 1, GL_FLOAT, GL_FALSE, offsetof(vertex2d, tex_index));
+    for (unsigned attrib = 0; attrib < 4; ++attrib)
+    {
+        glVertexArrayAttribBinding(vao, attrib, 0);
+        glEnableVertexArrayAttrib(vao, attrib);
+    }
     glBindVertexArray(vao);
+    create_ring(1);
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * sizeof(quad2d), nullptr, GL_DYNAMIC_DRAW);
-
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(index_type),
-        indices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex2d),
-        (const void*)offsetof(vertex2d, position));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex2d),
-        (const void*)offsetof(vertex2d, tint));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex2d),
-        (const void*)offsetof(vertex2d, tex_coord));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(vertex2d),
-        (const void*)offsetof(vertex2d, tex_index));
-    glEnableVertexAttribArray(3);
+    /* A context without a surface has no default framebuffer to draw to */
+    if (headless)
+    {
+        glCreateRenderbuffers(1, &offscreen_rbo);
+        glNamedRenderbufferStorage(offscreen_rbo, GL_RGBA8, WINDOW_WIDTH, WINDOW_HEIGHT);
+        glCreateFramebuffers(1, &offscreen_fbo);
+        glNamedFramebufferRenderbuffer(offscreen_fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen_rbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen_fbo);
+        glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
 
     tile_tex.bind(TILES_TEX_SLOT);
     text_tex.bind(TEXT_TEX_SLOT);
 
+    /* The samplers and the frame block are bound in the shaders */
+    program.check_block("frame", FRAME_BINDING, sizeof(frame_uniforms));
     program.bind();
-    program.fill_tex_slots("tex_array");
-    program.uniform("projection", glm::ortho(
-        PLAYFIELD_LEFT, PLAYFIELD_RIGHT, PLAYFIELD_BOTTOM, PLAYFIELD_TOP));
+    frame->projection = glm::ortho(
+        PLAYFIELD_LEFT, PLAYFIELD_RIGHT, PLAYFIELD_BOTTOM, PLAYFIELD_TOP);
 }
 
 renderer2d::~renderer2d() noexcept
 {
-    delete[] buffer;
+    for (GLsync fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    glUnmapNamedBuffer(vbo);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
     glDeleteVertexArrays(1, &vao);
+    if (headless)
+    {
+        glDeleteFramebuffers(1, &offscreen_fbo);
+        glDeleteRenderbuffers(1, &offscreen_rbo);
+    }
     glfwTerminate();
 }
 
 void renderer2d::submit_calls()
 {
     auto &instance = get_instance();
+    instance.begin(CALLS_AREA);
 
     constexpr glm::vec2 CALL_TEXT_WIDTH = { CALL_TEXT_SIZE.x, 0.f };
 
@@ -144,20 +163,18 @@ void renderer2d::submit_calls()
 void renderer2d::submit(int number, glm::vec2 topleft, int relative_pos)
 {
     auto &instance = get_instance();
-    std::vector<quad2d> quads (std::move(instance.text_tex.render_num(
-        number, topleft, {10.f, 0.0f}, {0.0f, -5.f})));
+    instance.begin(SCORE_AREA);
 
-    memcpy(instance.buffer_ptr, quads.data(), quads.size() * sizeof(quad2d));
-    instance.buffer_ptr += quads.size();
-    instance.num_quads += quads.size();
+    if (quad2d *out = instance.room(text::MAX_DIGITS))
+        instance.advance(instance.text_tex.render_num(
+            number, topleft, {10.f, 0.0f}, {0.0f, -5.f}, out));
 }
 
 void renderer2d::submit(text::game_call call, glm::vec2 topleft, bool active)
 {
     quad2d q = text_tex.render_call(call, topleft, CALL_TEXT_SIZE_INTERN);
     q.tint(active ? AVAILABLE_CALL : UNAVAILABLE_CALL);
-    *buffer_ptr++ = q;
-    num_quads++;
+    push(q);
 }
 
 void renderer2d::submit(mj_hand const &hand, int relative_pos)
@@ -185,6 +202,7 @@ void renderer2d::submit(mj_hand const &hand, int relative_pos)
     }
 
     auto &instance = get_instance();
+    instance.begin(HAND_AREA + relative_pos);
     for (int i = 0; i < hand.size; ++i)
         instance.submit(hand.tiles[i], relative_pos,
             base + static_cast<float>(i)*offset);
@@ -225,6 +243,7 @@ void renderer2d::submit(mj_meld const &melds, int relative_pos)
     }
 
     auto &instance = get_instance();
+    instance.begin(MELDS_AREA + relative_pos);
     for (auto *trip_ptr = melds.melds; trip_ptr < melds.melds + melds.size; ++trip_ptr)
     {
         if (MJ_IS_OPEN(*trip_ptr) && MJ_IS_KONG(*trip_ptr)) /* Open Kong */
@@ -372,9 +391,7 @@ void renderer2d::submit(mj_tile tile, int orientation, glm::vec2 pos, glm::vec4
 
     q.tex_index(TILES_TEX_SLOT);
 
-    *buffer_ptr = q;
-    buffer_ptr++;
-    num_quads++;
+    push(q);
 }
 
 void renderer2d::submit(mj_tile tile, glm::vec2 pos, int relative_pos, int turn, int riichi_turn)
@@ -445,11 +462,108 @@ void renderer2d::flush()
     get_instance().flush_impl();
 }
 
+/**
+ * A new list is written to the next region of the ring, only the areas
+ * whose version is not the one already in that region. The exchange acquires
+ * the quads written by the game thread before it published them. The areas
+ * are drawn in one call, each from its own range, and the draw is fenced so
+ * the region is not written again before the GPU is done with it.
+ */
 void renderer2d::flush_impl()
 {
-    if (buffer_ptr != buffer)
-        glBufferSubData(GL_ARRAY_BUFFER, 0, num_quads * sizeof(quad2d), buffer);
-    glDrawElements(GL_TRIANGLES, num_quads * 6, GL_UNSIGNED_INT, nullptr);
+    bool const fresh = latest.load(std::memory_order_relaxed) & FRESH;
+    std::size_t uploaded_quads = 0;
+    if (fresh)
+    {
+        presented = latest.exchange(presented, std::memory_order_acq_rel) & ~FRESH;
+        auto const &list = lists[presented];
+        if (list.scale != ring_scale)
+            create_ring(list.scale);
+
+        region = (region + 1) % RING_SIZE;
+        wait_region(region);
+        quad2d *const base = mapped + region * BASE_QUADS * ring_scale;
+        for (int a = 0; a < NUM_AREAS; ++a)
+        {
+            if (list.versions[a] == uploaded[region][a])
+                continue;
+            std::size_t const offset = AREA_OFFSET[a] * ring_scale;
+            std::copy_n(list.quads.data() + offset, list.sizes[a], base + offset);
+            uploaded[region][a] = list.versions[a];
+            uploaded_quads += list.sizes[a];
+        }
+    }
+
+    auto const &list = lists[presented];
+    std::array<GLsizei, NUM_AREAS> counts;
+    std::array<void const *, NUM_AREAS> starts {};
+    std::array<GLint, NUM_AREAS> base_vertices;
+    for (int a = 0; a < NUM_AREAS; ++a)
+    {
+        counts[a] = list.sizes[a] * 6;
+        base_vertices[a] = (region * BASE_QUADS + AREA_OFFSET[a]) * ring_scale * 4;
+    }
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT,
+        starts.data(), NUM_AREAS, base_vertices.data());
+
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    trace.flushed(fresh, list.published, uploaded_quads);
+}
+
+void renderer2d::wait_region(int r) noexcept
+{
+    if (!fences[r])
+        return;
+    while (glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED)
+        {}
+    glDeleteSync(fences[r]);
+    fences[r] = nullptr;
+}
+
+/**
+ * The regions are remapped when the scene grows, after the GPU is done with
+ * all of them, and everything is written again. The indices of one area are
+ * enough, as each area is drawn with its own base vertex.
+ */
+void renderer2d::create_ring(unsigned scale)
+{
+    for (int r = 0; r < RING_SIZE; ++r)
+        wait_region(r);
+    if (vbo)
+    {
+        glUnmapNamedBuffer(vbo);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+    }
+
+    GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr const size = RING_SIZE * BASE_QUADS * scale * sizeof(quad2d);
+    glCreateBuffers(1, &vbo);
+    glNamedBufferStorage(vbo, size, nullptr, flags);
+    mapped = static_cast<quad2d *>(glMapNamedBufferRange(vbo, 0, size, flags));
+    if (!mapped)
+        throw std::runtime_error("Failed to map the vertex buffer.");
+
+    std::size_t const quads = BASE_LARGEST_AREA * scale;
+    std::vector<index_type> indices(quads * 6);
+    for (std::size_t i = 0; i < quads; ++i)
+    {
+        index_type const first = i * 4;
+        std::array<index_type, 6> const quad {
+            first, first + 1, first + 2, first + 2, first + 3, first };
+        std::copy(quad.begin(), quad.end(), indices.begin() + i * 6);
+    }
+    glCreateBuffers(1, &ebo);
+    glNamedBufferStorage(ebo, indices.size() * sizeof(index_type), indices.data(), 0);
+
+    glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(vertex2d));
+    glVertexArrayElementBuffer(vao, ebo);
+
+    ring_scale = scale;
+    for (auto &versions : uploaded)
+        versions.fill(0);
 }
 
 void renderer2d::clear()
@@ -459,8 +573,56 @@ void renderer2d::clear()
 
 void renderer2d::clear_impl()
 {
-    buffer_ptr = buffer;
-    num_quads = 0;
+    for (int a = 0; a < NUM_AREAS; ++a)
+        begin(a);
+}
+
+bool renderer2d::grow_scene()
+{
+    if (scene.scale == MAX_SCALE)
+        return false;
+
+    unsigned const scale = scene.scale * 2;
+    std::vector<quad2d> quads(BASE_QUADS * scale);
+    for (int a = 0; a < NUM_AREAS; ++a)
+        std::copy_n(scene.quads.begin() + AREA_OFFSET[a] * scene.scale, scene.sizes[a],
+            quads.begin() + AREA_OFFSET[a] * scale);
+    scene.quads = std::move(quads);
+    scene.scale = scale;
+    return true;
+}
+
+void renderer2d::publish()
+{
+    get_instance().publish_impl();
+}
+
+/**
+ * The list of the game thread is at most two publishes old, so only the
+ * areas submitted since are copied to it, unless the scene grew since.
+ */
+void renderer2d::publish_impl()
+{
+    auto &list = lists[building];
+    bool const grown = list.scale != scene.scale;
+    if (grown)
+    {
+        list.quads.resize(scene.quads.size());
+        list.scale = scene.scale;
+    }
+
+    for (int a = 0; a < NUM_AREAS; ++a)
+    {
+        if (!grown && list.versions[a] == scene.versions[a])
+            continue;
+        std::size_t const offset = AREA_OFFSET[a] * scene.scale;
+        std::copy_n(scene.quads.begin() + offset, scene.sizes[a], list.quads.begin() + offset);
+        list.sizes[a] = scene.sizes[a];
+        list.versions[a] = scene.versions[a];
+    }
+    list.published = frame_trace::clock_type::now();
+    building = latest.exchange(building | FRESH, std::memory_order_acq_rel) & ~FRESH;
 }
 
 unsigned char renderer2d::call_flags {};
+bool renderer2d::headless {};
@@ -8,8 +8,14 @@
 #include "shader.hpp"
 #include "texture.hpp"
 #include "text.hpp"
+#include "trace.hpp"
 #include "mahjong/mahjong.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -22,10 +28,38 @@ debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
 			  GLsizei length, const GLchar *message, const void *userParam);
 #endif
 
+/**
+ * @brief The 2D renderer, shared by two threads: the game thread submits the
+ * quads of a frame, and the render thread flushes the latest complete frame.
+ *
+ * @details The scene is retained: it is split in areas (the hand, discards and
+ * melds of each player, the score and the calls), each with its own range of
+ * the vertex buffer. A submit replaces the quads of one area only, and the
+ * render thread only uploads the areas that changed since their last upload.
+ * An area that overflows doubles the size of every area, so the layout is
+ * always the base layout times a scale.
+ *
+ * The frames are triple buffered. The game thread edits the scene, and
+ * publish copies the changed areas to its own list and swaps it with the
+ * latest list; the render thread swaps the latest list with the one it draws
+ * when there is a newer one. Neither thread ever waits for the other, and a
+ * frame is never drawn half built.
+ *
+ * The vertex buffer is a ring of RING_SIZE regions, persistently mapped, each
+ * holding the whole scene. A new frame is written to the next region with a
+ * plain copy, once the fence of the last draw from that region has passed,
+ * so the driver never has to synchronize an upload with the GPU.
+ *
+ * The renderer must be created on the render thread (by window_ptr for
+ * example), which owns the OpenGL context. It is headless if headless is set
+ * then, for benchmarks and tests, and the frames can be read back with
+ * glReadPixels.
+ */
 class renderer2d
 {
 public:
-    static constexpr std::size_t MAX_QUADS = 256;
+    /* The areas grow by doubling up to this many times their base size */
+    static constexpr unsigned MAX_SCALE = 16;
 
     static constexpr int
         OPENGL_VERSION      = 4,
@@ -69,6 +103,7 @@ private:
     static constexpr int
         TILES_TEX_SLOT      = 0,
         TEXT_TEX_SLOT       = 1,
+        FRAME_BINDING       = 0,
         DISCARDS_PER_LINE   = 6;
     static constexpr float
         TILE_WIDTH_INTERN   = 2.77f,
@@ -79,6 +114,14 @@ private:
 public:
     static unsigned char call_flags;
 
+    /**
+     * Render without a display: the context is an EGL one without a surface
+     * (on the null platform of GLFW 3.4 and later), and the frames are drawn
+     * to an offscreen framebuffer of the size of the window. Set it before
+     * the renderer is created.
+     */
+    static bool headless;
+
 public:
     ~renderer2d() noexcept;
 
@@ -93,10 +136,11 @@ public:
 
     static void submit(mj_hand const &hand, int relative_pos);
 
-    template<typename Allocator>
-    static void submit(std::vector<mj_tile, Allocator> const &discards, int relative_pos, int riichi_turn=0x7fff)
+    template<typename Discards>
+    static void submit(Discards const &discards, int relative_pos, int riichi_turn=0x7fff)
     {
         auto &instance = get_instance();
+        instance.begin(DISCARDS_AREA + relative_pos);
         for (int i = 0; i < std::min(18ul, discards.size()); ++i)
             instance.submit(discards[i], {i%DISCARDS_PER_LINE, i/DISCARDS_PER_LINE},
                 relative_pos, i, riichi_turn);
@@ -107,9 +151,24 @@ public:
 
     static void submit(mj_meld const &meld, int relative_pos);
 
+    /**
+     * @brief Draw the latest published frame, uploading it if it is new.
+     * Render thread only.
+     */
     static void flush();
+
+    /**
+     * @brief Empty every area. Game thread only, like submit.
+     */
     static void clear();
 
+    /**
+     * @brief Make the scene as submitted so far the one to draw.
+     */
+    static void publish();
+
+    static inline frame_trace &frames() { return get_instance().trace; }
+
     static inline GLFWwindow *window_ptr() { return get_instance().window; }
 
 private:
@@ -117,13 +176,82 @@ private:
     renderer2d();
     GLFWwindow *window;
 
-    unsigned int vao, vbo, ebo;
+    unsigned int vao, vbo {}, ebo {};
 
-    quad2d *buffer, *buffer_ptr;
+    /* The framebuffer drawn to when headless */
+    unsigned int offscreen_fbo {}, offscreen_rbo {};
 
-    std::size_t num_quads {};
+    /* The areas of the scene, the first three per relative position */
+    static constexpr int
+        HAND_AREA           = 0,
+        DISCARDS_AREA       = 4,
+        MELDS_AREA          = 8,
+        SCORE_AREA          = 12,
+        CALLS_AREA          = 13,
+        NUM_AREAS           = 14;
+
+    /* The quads each area holds at scale 1 */
+    static constexpr std::array<std::size_t, NUM_AREAS> AREA_CAPACITY {
+        18, 18, 18, 18,
+        24, 24, 24, 24,
+        16, 16, 16, 16,
+        text::MAX_DIGITS, 6 };
+
+    /* Where the quads of each area start at scale 1 */
+    static constexpr std::array<std::size_t, NUM_AREAS> AREA_OFFSET = []() {
+        std::array<std::size_t, NUM_AREAS> offsets {};
+        for (int a = 1; a < NUM_AREAS; ++a)
+            offsets[a] = offsets[a - 1] + AREA_CAPACITY[a - 1];
+        return offsets;
+    }();
+
+    static constexpr std::size_t
+        BASE_QUADS = AREA_OFFSET[NUM_AREAS - 1] + AREA_CAPACITY[NUM_AREAS - 1],
+        BASE_LARGEST_AREA = *std::max_element(AREA_CAPACITY.begin(), AREA_CAPACITY.end());
+
+    /* Regions of the vertex buffer, the frames the GPU may still be reading */
+    static constexpr int RING_SIZE = 3;
+
+    /**
+     * The quads of every area, and the version of each area, which changes
+     * on every submit to it.
+     */
+    struct frame_list
+    {
+        std::vector<quad2d>                     quads = std::vector<quad2d>(BASE_QUADS);
+        unsigned                                scale = 1;
+        std::array<std::size_t, NUM_AREAS>      sizes {};
+        std::array<unsigned, NUM_AREAS>         versions {};
+        frame_trace::clock_type::time_point     published;
+    };
 
-    static constexpr quad_indices<MAX_QUADS> indices {};
+    /* The scene, and the area submits go to (game thread) */
+    frame_list scene {};
+    int current = HAND_AREA;
+
+    /* The mapped regions and what they hold (render thread) */
+    quad2d *mapped = nullptr;
+    unsigned ring_scale = 0;
+    int region = 0;
+    std::array<GLsync, RING_SIZE> fences {};
+    std::array<std::array<unsigned, NUM_AREAS>, RING_SIZE> uploaded {};
+
+    /* Set in latest when the list was published and not flushed yet */
+    static constexpr unsigned FRESH = 4;
+
+    std::array<frame_list, 3> lists {};
+    unsigned building = 0;          /* game thread */
+    unsigned presented = 1;         /* render thread */
+    std::atomic<unsigned> latest { 2 };
+
+    frame_trace trace;
+
+    /* The uniforms of the program, laid out as its std140 frame block */
+    struct frame_uniforms
+    {
+        glm::mat4 projection;
+    };
+    static_assert(sizeof(frame_uniforms) == 64, "frame_uniforms must match std140");
 
     shader program {
 "#version 450 core\n"
@@ -134,7 +262,7 @@ private:
 "out vec2 tex_coord_out;\n"
 "out float tex_idx_out;\n"
 "out vec4 tint_out;\n"
-"uniform mat4 projection;\n"
+"layout (std140, binding = 0) uniform frame { mat4 projection; };\n"
 "void main() {\n"
 "    tex_coord_out = tex_coord;\n"
 "    tex_idx_out = tex_idx;\n"
@@ -145,19 +273,60 @@ private:
 "in vec2 tex_coord_out;\n"
 "in float tex_idx_out;\n"
 "in vec4 tint_out;\n"
-"uniform sampler2D tex_array[8];\n"
+"layout (binding = 0) uniform sampler2D tex_array[8];\n"
 "out vec4 color;\n"
 "void main() {\n"
 "    color = texture(tex_array[int(tex_idx_out)], tex_coord_out) * tint_out;\n"
 "}\n"
     };
 
+    uniform_block<frame_uniforms> frame { FRAME_BINDING };
+
     texture tile_tex {"/home/john/CLionProjects/washizu-mahjong/assets/texture/tiles.png"};
     text text_tex {"/home/john/CLionProjects/washizu-mahjong/assets/texture/text.png"};
 
 private:
     void flush_impl();
     void clear_impl();
+    void publish_impl();
+
+    /* Replace the quads of an area with the ones pushed next */
+    void begin(int area) noexcept
+    {
+        current = area;
+        scene.sizes[area] = 0;
+        ++scene.versions[area];
+    }
+
+    void push(quad2d const &q)
+    {
+        auto &size = scene.sizes[current];
+        if (size == AREA_CAPACITY[current] * scene.scale && !grow_scene())
+            return;
+        scene.quads[AREA_OFFSET[current] * scene.scale + size++] = q;
+    }
+
+    /* Room for n quads after the ones of the area, to fill then advance
+     * over, or nullptr if the scene cannot grow enough */
+    quad2d *room(std::size_t n)
+    {
+        while (scene.sizes[current] + n > AREA_CAPACITY[current] * scene.scale)
+            if (!grow_scene())
+                return nullptr;
+        return &scene.quads[AREA_OFFSET[current] * scene.scale + scene.sizes[current]];
+    }
+
+    void advance(std::size_t n) noexcept { scene.sizes[current] += n; }
+
+    /* Double the scale of the scene, false at MAX_SCALE (game thread) */
+    bool grow_scene();
+
+    /* Wait until the GPU is done with a region of the ring */
+    void wait_region(int r) noexcept;
+
+    /* Map a ring, and make the indices, for the scale (render thread) */
+    void create_ring(unsigned scale);
+
     void submit(mj_tile tile, int orientation, glm::vec2 pos, glm::vec4 tint=DEFAULT_TINT);
     void submit(mj_tile tile, glm::vec2 pos, int relative_pos, int turn, int riichi_turn);
     void submit(text::game_call call, glm::vec2 topleft, bool active);
@@ -0,0 +1,341 @@
+#define GLM_FORCE_RADIANS
+
+#include "3d.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef NDEBUG
+
+static void APIENTRY
+debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+               GLsizei length, const GLchar *message, const void *userParam)
+{
+    if (severity == GL_DEBUG_SEVERITY_HIGH || severity == GL_DEBUG_SEVERITY_MEDIUM)
+    {
+        std::cerr << "OpenGL error " << id << ": " << message << std::endl;
+        throw std::runtime_error("OpenGL error");
+    }
+    if (severity == GL_DEBUG_SEVERITY_LOW)
+        std::cerr << "OpenGL warning " << id << ": " << message << std::endl;
+}
+
+#endif
+
+static constexpr float QUARTER_TURN = 1.57079632679f;
+
+renderer3d &renderer3d::get_instance()
+{
+    static renderer3d instance;
+    return instance;
+}
+
+GLFWwindow *renderer3d::init_window()
+{
+    if (!glfwInit())
+        return nullptr;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, OPENGL_VERSION);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, OPENGL_SUBVERSION);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, OPENGL_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+    GLFWwindow *new_window = glfwCreateWindow(
+        WINDOW_WIDTH, WINDOW_HEIGHT, "Washizu Mahjong", nullptr, nullptr);
+
+    if (!new_window)
+        return nullptr;
+
+    glfwMakeContextCurrent(new_window);
+    glfwSwapInterval(1);
+
+    if (glewInit() != GLEW_OK)
+        return nullptr;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+#ifndef NDEBUG
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(debug_callback, nullptr);
+#endif
+
+    return new_window;
+}
+
+/**
+ * The camera starts behind your hand, looking down at the center of the
+ * table. The wall is laid out once: WALL_STACKS stacks of two in front of each
+ * player, the top tile of a stack first.
+ */
+renderer3d::renderer3d()
+    : window(init_window()),
+      eye(static_cast<float>(WINDOW_WIDTH) / WINDOW_HEIGHT,
+          { 0.f, 15.f, 24.f }, { 0.f, -15.f, -24.f }, { 0.f, 1.f, 0.f }, 0.8f)
+{
+    if (!window)
+        throw std::runtime_error("Failed to initialize renderer3d window.");
+
+    for (int side = 0; side < 4; ++side)
+        for (int stack = 0; stack < WALL_STACKS; ++stack)
+            for (int level = 0; level < 2; ++level)
+            {
+                glm::vec3 const pos {
+                    (stack - (WALL_STACKS - 1) / 2.f) * TILE_WIDTH,
+                    (1.5f - level) * TILE_DEPTH,
+                    WALL_DISTANCE };
+                wall[(side * WALL_STACKS + stack) * 2 + level] =
+                    place(MJ_INVALID_TILE, side, pos, false, false, true).model;
+            }
+
+    for (auto &area : areas)
+        area.reserve(MJ_DECK_SIZE / 4);
+
+    create_mesh();
+
+    glCreateBuffers(1, &ssbo);
+    glNamedBufferStorage(ssbo, sizeof(frame_list::instances), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, ssbo);
+
+    tile_tex.bind(TILES_TEX_SLOT);
+    program.check_location("view_projection", VIEW_PROJECTION);
+    program.bind();
+}
+
+renderer3d::~renderer3d() noexcept
+{
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &ssbo);
+    glDeleteVertexArrays(1, &vao);
+    glfwTerminate();
+}
+
+/**
+ * Each face is a quad wound counterclockwise from the outside, so the faces
+ * turned away are culled. The front (+z) is the face of the tile, the back
+ * (-z) is the back of the tile, and the four sides have no texture.
+ */
+void renderer3d::create_mesh()
+{
+    struct face_axes { glm::vec3 normal, right, up; float face; };
+    constexpr std::array<face_axes, 6> FACES {{
+        { {  0.f,  0.f,  1.f }, {  1.f, 0.f,  0.f }, { 0.f, 1.f,  0.f }, 0.f },
+        { {  0.f,  0.f, -1.f }, { -1.f, 0.f,  0.f }, { 0.f, 1.f,  0.f }, 1.f },
+        { {  1.f,  0.f,  0.f }, {  0.f, 0.f, -1.f }, { 0.f, 1.f,  0.f }, 2.f },
+        { { -1.f,  0.f,  0.f }, {  0.f, 0.f,  1.f }, { 0.f, 1.f,  0.f }, 2.f },
+        { {  0.f,  1.f,  0.f }, {  1.f, 0.f,  0.f }, { 0.f, 0.f, -1.f }, 2.f },
+        { {  0.f, -1.f,  0.f }, {  1.f, 0.f,  0.f }, { 0.f, 0.f,  1.f }, 2.f },
+    }};
+    constexpr glm::vec3 HALF { TILE_WIDTH / 2, TILE_HEIGHT / 2, TILE_DEPTH / 2 };
+    constexpr std::array<glm::vec2, 4> CORNERS {{
+        { -1.f, -1.f }, { 1.f, -1.f }, { 1.f, 1.f }, { -1.f, 1.f } }};
+
+    std::array<vertex3d, 24> vertices;
+    quad_indices<6> const indices;
+    for (int f = 0; f < 6; ++f)
+        for (int c = 0; c < 4; ++c)
+        {
+            auto &v = vertices[f * 4 + c];
+            auto const &axes = FACES[f];
+            v.position = (axes.normal + CORNERS[c].x * axes.right + CORNERS[c].y * axes.up) * HALF;
+            v.tex_coord = { (CORNERS[c].x + 1.f) / 2, (1.f - CORNERS[c].y) / 2 };
+            v.normal = axes.normal;
+            v.tex_index = axes.face;
+        }
+
+    glCreateBuffers(1, &vbo);
+    glNamedBufferStorage(vbo, sizeof vertices, vertices.data(), 0);
+    glCreateBuffers(1, &ebo);
+    glNamedBufferStorage(ebo, sizeof(index_type) * BOX_INDICES, indices.data(), 0);
+
+    glCreateVertexArrays(1, &vao);
+    glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(vertex3d));
+    glVertexArrayElementBuffer(vao, ebo);
+    glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(vertex3d, position));
+    glVertexArrayAttribFormat(vao, 1, 2, GL_FLOAT, GL_FALSE, offsetof(vertex3d, tex_coord));
+    glVertexArrayAttribFormat(vao, 2, 3, GL_FLOAT, GL_FALSE, offsetof(vertex3d, normal));
+    glVertexArrayAttribFormat(vao, 3, 1, GL_FLOAT, GL_FALSE, offsetof(vertex3d, tex_index));
+    for (unsigned attrib = 0; attrib < 4; ++attrib)
+    {
+        glVertexArrayAttribBinding(vao, attrib, 0);
+        glEnableVertexArrayAttrib(vao, attrib);
+    }
+    glBindVertexArray(vao);
+}
+
+/**
+ * The position is on the side of your seat, where the table center is toward
+ * -z and you sit at +z; the tile is turned to the side of its player. A tile
+ * lies with its top toward the center, readable by its player, and an upright
+ * tile faces its player.
+ */
+renderer3d::tile_instance renderer3d::place(mj_tile tile, int relative_pos, glm::vec3 pos,
+    bool sideways, bool upright, bool face_down)
+{
+    glm::mat4 model = glm::rotate(glm::mat4(1.f), relative_pos * QUARTER_TURN, { 0.f, 1.f, 0.f });
+    model = glm::translate(model, pos);
+    if (sideways)
+        model = glm::rotate(model, QUARTER_TURN, { 0.f, 1.f, 0.f });
+    if (!upright)
+        model = glm::rotate(model, face_down ? QUARTER_TURN : -QUARTER_TURN, { 1.f, 0.f, 0.f });
+
+    if (tile == MJ_INVALID_TILE)
+        return { model, { 0.f, 0.f, 0.f, 1.f } };
+
+    mj_tile const t = tile & ~TSUMOGIRI_FLAG;
+    float const idx34 = MJ_SUIT(t) == MJ_DRAGON ? 31 + MJ_NUMBER(t) : MJ_NUMBER(t) + MJ_SUIT(t) * 9;
+    return { model, { idx34, MJ_IS_OPAQUE(t) == MJ_TRUE ? 1.f : 0.f,
+        tile & TSUMOGIRI_FLAG ? 1.f : 0.f, face_down ? 1.f : 0.f } };
+}
+
+renderer3d::tile_instance renderer3d::discard(mj_tile tile, int turn, int relative_pos, bool riichi)
+{
+    int const line = std::min(turn / DISCARDS_PER_LINE, 3);
+    int const column = line < 3 ? turn % DISCARDS_PER_LINE : turn - 3 * DISCARDS_PER_LINE;
+    glm::vec3 const pos {
+        (column - (DISCARDS_PER_LINE - 1) / 2.f) * TILE_WIDTH,
+        TILE_DEPTH / 2,
+        DISCARDS_DISTANCE + line * TILE_HEIGHT };
+    return place(tile, relative_pos, pos, riichi);
+}
+
+glm::vec3 renderer3d::hand_position(int i, int size) noexcept
+{
+    return { (i - (size - 1) / 2.f) * TILE_WIDTH, TILE_HEIGHT / 2, HAND_DISTANCE };
+}
+
+void renderer3d::submit(mj_hand const &hand, int relative_pos)
+{
+    auto &instance = get_instance();
+    auto &area = instance.begin(HAND_AREA + relative_pos);
+    for (int i = 0; i < hand.size; ++i)
+        area.push_back(place(hand.tiles[i], relative_pos,
+            hand_position(i, hand.size), false, true));
+}
+
+/**
+ * The melds are laid from the right corner of their player toward the left,
+ * the called tile sideways and the outer tiles of a closed kong face down.
+ */
+void renderer3d::submit(mj_meld const &melds, int relative_pos)
+{
+    auto &instance = get_instance();
+    auto &area = instance.begin(MELDS_AREA + relative_pos);
+    float right = MELDS_RIGHT;
+    for (auto *trip_ptr = melds.melds; trip_ptr < melds.melds + melds.size; ++trip_ptr)
+    {
+        bool const open = MJ_IS_OPEN(*trip_ptr);
+        bool const kong = MJ_IS_KONG(*trip_ptr);
+        std::array<mj_tile, 3> const triple {
+            MJ_FIRST(*trip_ptr), MJ_SECOND(*trip_ptr), MJ_THIRD(*trip_ptr) };
+
+        int const count = kong ? 4 : 3;
+        for (int i = 0; i < count; ++i)
+        {
+            bool const called = open && i == 0;
+            float const width = called ? TILE_HEIGHT : TILE_WIDTH;
+            glm::vec3 const pos { right - width / 2, TILE_DEPTH / 2, MELDS_DISTANCE };
+            bool const hidden = !open && (i == 0 || i == 3);
+            mj_tile const tile = kong ? triple[0] ^ i : triple[i];
+            area.push_back(place(tile, relative_pos, pos, called, false, hidden));
+            right -= width;
+        }
+    }
+}
+
+void renderer3d::flush()
+{
+    get_instance().flush_impl();
+}
+
+/**
+ * The instances of a new frame are uploaded whole, they are only a few
+ * kilobytes, then the table is one instanced draw of the box.
+ */
+void renderer3d::flush_impl()
+{
+    bool const fresh = latest.load(std::memory_order_relaxed) & FRESH;
+    if (fresh)
+    {
+        presented = latest.exchange(presented, std::memory_order_acq_rel) & ~FRESH;
+        auto const &list = lists[presented];
+        glNamedBufferSubData(ssbo, 0, list.size * sizeof(tile_instance), list.instances.data());
+    }
+
+    auto const &list = lists[presented];
+    shader::uniform(VIEW_PROJECTION, eye.view_projection());
+    glDrawElementsInstanced(GL_TRIANGLES, BOX_INDICES, GL_UNSIGNED_INT, nullptr, list.size);
+    trace.flushed(fresh, list.published, fresh ? list.size : 0);
+}
+
+void renderer3d::clear()
+{
+    auto &instance = get_instance();
+    for (int a = 0; a < NUM_AREAS; ++a)
+        instance.begin(a);
+}
+
+void renderer3d::publish()
+{
+    get_instance().publish_impl();
+}
+
+/**
+ * The placed tiles are copied area by area, then the wall gets the tiles left,
+ * from its first place.
+ */
+void renderer3d::publish_impl()
+{
+    auto &list = lists[building];
+    std::size_t size = 0;
+    for (auto const &area : areas)
+    {
+        std::size_t const n = std::min(area.size(), list.instances.size() - size);
+        std::copy_n(area.begin(), n, list.instances.begin() + size);
+        size += n;
+    }
+    for (std::size_t i = 0; size < list.instances.size(); ++i, ++size)
+        list.instances[size] = { wall[i], { 0.f, 0.f, 0.f, 1.f } };
+
+    list.size = size;
+    list.hand_size = areas[HAND_AREA].size();
+    list.published = frame_trace::clock_type::now();
+    building = latest.exchange(building | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+int renderer3d::hand_tile_at(double x, double y)
+{
+    return get_instance().hand_tile_at_impl(x, y);
+}
+
+/**
+ * The front face of each tile of your hand is projected to the window, and
+ * the point is tested against its bounds.
+ */
+int renderer3d::hand_tile_at_impl(double x, double y) const
+{
+    glm::mat4 const view_projection = eye.view_projection();
+    auto to_window = [&](glm::vec3 p) {
+        glm::vec4 const clip = view_projection * glm::vec4(p, 1.f);
+        return glm::vec2 {
+            (clip.x / clip.w + 1.f) / 2 * WINDOW_WIDTH,
+            (1.f - clip.y / clip.w) / 2 * WINDOW_HEIGHT };
+    };
+
+    int const size = lists[presented].hand_size;
+    for (int i = 0; i < size; ++i)
+    {
+        glm::vec3 const center = hand_position(i, size);
+        glm::vec2 const top_left = to_window(center +
+            glm::vec3 { -TILE_WIDTH / 2, TILE_HEIGHT / 2, TILE_DEPTH / 2 });
+        glm::vec2 const bottom_right = to_window(center +
+            glm::vec3 { TILE_WIDTH / 2, -TILE_HEIGHT / 2, TILE_DEPTH / 2 });
+        if (x >= top_left.x && x < bottom_right.x && y >= top_left.y && y < bottom_right.y)
+            return i + 1;
+    }
+    return 0;
+}
@@ -1,4 +1,253 @@
 #ifndef MJ_RENDERER_3D_HPP
 #define MJ_RENDERER_3D_HPP
+#define MJ_RENDERER
+
+#define GLEW_STATIC
+
+#include "camera.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include "trace.hpp"
+#include "mahjong/mahjong.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+/**
+ * @brief The 3D renderer, which draws the table with the 136 tiles, shared by
+ * the game thread that submits the tiles and the render thread that draws.
+ *
+ * @details Every tile is an instance of a single box mesh. An instance is its
+ * model matrix and the tile it shows, and the instances of a frame are stored
+ * in a shader storage buffer, so the whole table is one instanced draw of the
+ * 36 indices of the box, whatever is on it. Nothing is culled: 136 boxes cost
+ * less than sorting them out, even on a software rasterizer like llvmpipe.
+ * The faces sample the same atlas as the 2D renderer; the back and the sides
+ * of a tile, and the face of a tile you cannot see, are plain colors.
+ *
+ * The game thread submits the hands, discards and melds like for renderer2d,
+ * and the tiles that are not placed anywhere are drawn in the wall, face
+ * down. Frames are triple buffered as in renderer2d: publish hands a complete
+ * frame to the render thread, and neither thread waits for the other.
+ *
+ * The renderer must be created on the render thread (by window_ptr for
+ * example), which owns the OpenGL context and the camera.
+ */
+class renderer3d
+{
+public:
+    static constexpr int
+        OPENGL_VERSION      = 4,
+        OPENGL_SUBVERSION   = 5,
+        OPENGL_PROFILE      = GLFW_OPENGL_CORE_PROFILE,
+        WINDOW_WIDTH        = 1280,
+        WINDOW_HEIGHT       = 800;
+
+    /* The size of a tile, in the units of the table */
+    static constexpr float
+        TILE_WIDTH          = 1.0f,
+        TILE_HEIGHT         = 1.4f,
+        TILE_DEPTH          = 0.8f;
+
+    /* Distances from the center of the table, on the side of each player */
+    static constexpr float
+        DISCARDS_DISTANCE   = 3.8f,
+        WALL_DISTANCE       = 9.6f,
+        MELDS_DISTANCE      = 10.8f,
+        HAND_DISTANCE       = 12.2f,
+        MELDS_RIGHT         = 13.0f;
+
+    static constexpr int
+        DISCARDS_PER_LINE   = 6,
+        WALL_STACKS         = MJ_DECK_SIZE / 8;
+
+    static constexpr mj_tile TSUMOGIRI_FLAG = (1 << 14);
+
+    /**
+     * An instance of the tile mesh, laid out as the std430 struct of the
+     * vertex shader.
+     */
+    struct tile_instance
+    {
+        glm::mat4 model;
+        /* The column (x) and row (y) of the tile in the atlas, dimmed (z),
+         * hidden (w) */
+        glm::vec4 tile;
+    };
+    static_assert(sizeof(tile_instance) == 80, "tile_instance must match std430");
+
+public:
+    ~renderer3d() noexcept;
+
+    renderer3d(renderer3d const &) = delete;
+    renderer3d &operator=(renderer3d const &) = delete;
+
+    static renderer3d &get_instance();
+
+    static void submit(mj_hand const &hand, int relative_pos);
+
+    template<typename Discards>
+    static void submit(Discards const &discards, int relative_pos, int riichi_turn=0x7fff)
+    {
+        auto &instance = get_instance();
+        auto &area = instance.begin(DISCARDS_AREA + relative_pos);
+        for (int i = 0; i < discards.size(); ++i)
+            area.push_back(instance.discard(discards[i], i, relative_pos, i == riichi_turn));
+    }
+
+    static void submit(mj_meld const &meld, int relative_pos);
+
+    /**
+     * @brief Draw the latest published frame, uploading its instances if it
+     * is new. Render thread only.
+     */
+    static void flush();
+
+    /**
+     * @brief Take every tile off the table. Game thread only, like submit.
+     */
+    static void clear();
+
+    /**
+     * @brief Make the table as submitted so far the one to draw.
+     */
+    static void publish();
+
+    /**
+     * @brief The tile of your hand under a point of the window, in the frame
+     * last drawn. Render thread only.
+     *
+     * @return The position of the tile in the hand from 1, or 0 if there is
+     * none.
+     */
+    static int hand_tile_at(double x, double y);
+
+    static inline camera &view() { return get_instance().eye; }
+
+    static inline frame_trace &frames() { return get_instance().trace; }
+
+    static inline GLFWwindow *window_ptr() { return get_instance().window; }
+
+private:
+    GLFWwindow *init_window();
+    renderer3d();
+    GLFWwindow *window;
+
+    unsigned int vao, vbo, ebo, ssbo;
+
+    /* The areas of the table, per relative position */
+    static constexpr int
+        HAND_AREA           = 0,
+        DISCARDS_AREA       = 4,
+        MELDS_AREA          = 8,
+        NUM_AREAS           = 12;
+
+    static constexpr int
+        TILES_TEX_SLOT      = 0,
+        INSTANCES_BINDING   = 0,
+        VIEW_PROJECTION     = 0,
+        BOX_INDICES         = 36;
+
+    /**
+     * The instances of a frame, the placed tiles followed by the wall, and
+     * the size of your hand for picking.
+     */
+    struct frame_list
+    {
+        std::array<tile_instance, MJ_DECK_SIZE>     instances;
+        std::size_t                                 size = 0;
+        int                                         hand_size = 0;
+        frame_trace::clock_type::time_point         published;
+    };
+
+    /* The tiles of each area (game thread) */
+    std::array<std::vector<tile_instance>, NUM_AREAS> areas;
+
+    /* The places of the wall, filled in order by the tiles not placed */
+    std::array<glm::mat4, MJ_DECK_SIZE> wall;
+
+    /* Set in latest when the list was published and not flushed yet */
+    static constexpr unsigned FRESH = 4;
+
+    std::array<frame_list, 3> lists {};
+    unsigned building = 0;          /* game thread */
+    unsigned presented = 1;         /* render thread */
+    std::atomic<unsigned> latest { 2 };
+
+    camera eye;
+    frame_trace trace;
+
+    shader program {
+"#version 450 core\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 tex_coord;\n"
+"layout (location = 2) in vec3 normal;\n"
+"layout (location = 3) in float face;\n"
+"struct tile_instance { mat4 model; vec4 tile; };\n"
+"layout (std430, binding = 0) readonly buffer instances { tile_instance tiles[]; };\n"
+"layout (location = 0) uniform mat4 view_projection;\n"
+"out vec2 tex_coord_out;\n"
+"out vec3 normal_out;\n"
+"flat out float plain_out;\n"
+"flat out float dim_out;\n"
+"void main() {\n"
+"    tile_instance t = tiles[gl_InstanceID];\n"
+"    tex_coord_out = vec2((t.tile.x + tex_coord.x) / 34.0, (t.tile.y + tex_coord.y) * 0.5);\n"
+"    normal_out = mat3(t.model) * normal;\n"
+"    plain_out = face != 0.0 ? face : t.tile.w;\n"
+"    dim_out = t.tile.z;\n"
+"    gl_Position = view_projection * t.model * vec4(position, 1.0);\n"
+"}\n",
+"#version 450 core\n"
+"in vec2 tex_coord_out;\n"
+"in vec3 normal_out;\n"
+"flat in float plain_out;\n"
+"flat in float dim_out;\n"
+"layout (binding = 0) uniform sampler2D atlas;\n"
+"out vec4 color;\n"
+"const vec3 LIGHT = normalize(vec3(0.3, 1.0, 0.5));\n"
+"const vec3 BACK = vec3(0.85, 0.55, 0.10);\n"
+"const vec3 SIDE = vec3(0.92, 0.89, 0.80);\n"
+"void main() {\n"
+"    float light = 0.45 + 0.55 * max(dot(normalize(normal_out), LIGHT), 0.0);\n"
+"    vec3 base = plain_out == 0.0 ? texture(atlas, tex_coord_out).rgb\n"
+"        : plain_out == 2.0 ? SIDE : BACK;\n"
+"    color = vec4(base * light * (1.0 - 0.25 * dim_out), 1.0);\n"
+"}\n"
+    };
+
+    texture tile_tex {"/home/john/CLionProjects/washizu-mahjong/assets/texture/tiles.png"};
+
+private:
+    void flush_impl();
+    void publish_impl();
+    int hand_tile_at_impl(double x, double y) const;
+
+    /* Empty an area for the tiles pushed next */
+    std::vector<tile_instance> &begin(int area) noexcept
+    {
+        areas[area].clear();
+        return areas[area];
+    }
+
+    /* Make the box of a tile, its face (0), back (1) and sides (2) told
+     * apart by tex_index */
+    void create_mesh();
+
+    /* Place a tile on the side of a player, lying on the table unless upright */
+    static tile_instance place(mj_tile tile, int relative_pos, glm::vec3 pos,
+        bool sideways=false, bool upright=false, bool face_down=false);
+
+    static tile_instance discard(mj_tile tile, int turn, int relative_pos, bool riichi);
+
+    /* The center of a tile of a hand of size tiles, on the side of its player */
+    static glm::vec3 hand_position(int i, int size) noexcept;
+};
 
 #endif
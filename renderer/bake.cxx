@@ -0,0 +1,44 @@
+#include "texture.hpp"
+#include <chrono>
+#include <cstdio>
+#include <exception>
+
+/*
+ * Build the caches of textures ahead of time, so the first start of the
+ * client does not decode them.
+ *
+ * Usage: BakeTextures <png>...
+ *
+ * Each cache is written next to its PNG, see texture::CACHE_SUFFIX.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <png>...\n", argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        bool baked = false;
+        try
+        {
+            baked = texture::bake(argv[i]);
+        }
+        catch (std::exception const &e)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], e.what());
+        }
+
+        std::chrono::duration<double, std::milli> const elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (baked)
+            printf("%s%s in %.0f ms\n", argv[i], texture::CACHE_SUFFIX, elapsed.count());
+        else
+            ++failures;
+    }
+    return failures ? 1 : 0;
+}
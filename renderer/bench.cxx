@@ -0,0 +1,316 @@
+#define cimg_display 0
+#define cimg_use_png 1
+
+#include "2d.hpp"
+#include "mahjong/interaction.h"
+#include "utils/optim.hpp"
+#include <CImg.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Benchmark of the 2D renderer without a display, replaying rounds into
+ * frames.
+ *
+ * Usage: BenchRenderer [-s seed] [-r rounds] [-o dir] [-t]
+ *
+ * A round is played from the seed: the deal, then turns of a draw and a
+ * discard, with a pong now and then, and the scores at the end. Every event
+ * submits the areas the 2D client submits for it and makes one frame. The
+ * frames are grouped in scenes, the phases of the round, and for each scene
+ * are reported:
+ *   - submit: the CPU time of the submits and the publish,
+ *   - gpu: the GPU time of the flush, from a timer query,
+ *   - frame: from the first submit to the end of the GPU work (glFinish).
+ * -t prints tab separated values instead of the table, to be tracked per
+ * commit. -o writes the last frame of each scene of the first round to
+ * dir/<scene>.png, for visual regression.
+ *
+ * The renderer is headless (renderer2d::headless), so no display is needed,
+ * only GLFW 3.4 and EGL; with Mesa's llvmpipe, the gpu time is the time of the
+ * software rasterizer.
+ */
+
+constexpr int NUM_PLAYERS            = 4;
+constexpr int HAND_SIZE              = 13;
+constexpr int TURNS                  = 70;
+
+using clock_type = std::chrono::steady_clock;
+
+/* xorshift64*, so the rounds only depend on the seed */
+static unsigned long long rng_state;
+
+static unsigned rng(unsigned bound)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 0x2545f4914f6cdd1dULL) >> 32) % bound;
+}
+
+struct scene
+{
+    char const *name;
+    /* The scene covers the frames of the turns before this one */
+    int last_turn;
+};
+
+static constexpr std::array<scene, 4> SCENES {{
+    { "deal", 0 },
+    { "opening", 24 },
+    { "midgame", 48 },
+    { "endgame", TURNS },
+}};
+
+struct stats
+{
+    int frames = 0;
+    double submit_us = 0, gpu_us = 0, frame_us = 0;
+    double max_frame_us = 0;
+};
+
+struct table
+{
+    std::array<mj_hand, NUM_PLAYERS> hands {};
+    std::array<mj_meld, NUM_PLAYERS> melds {};
+    std::array<small_vector<mj_tile, 24>, NUM_PLAYERS> discards;
+    std::vector<mj_tile> wall;
+};
+
+static std::vector<mj_tile> shuffled_deck()
+{
+    std::vector<mj_tile> tiles;
+    for (int suit = MJ_CHARACTER; suit <= MJ_BAMBOO; suit++)
+        for (int number = 0; number < 9; number++)
+            for (int sub = 0; sub < 4; sub++)
+                tiles.push_back(MJ_TILE(suit, number, sub));
+    for (int number = MJ_EAST; number <= MJ_NORTH; number++)
+        for (int sub = 0; sub < 4; sub++)
+            tiles.push_back(MJ_TILE(MJ_WIND, number, sub));
+    for (int number = MJ_GREEN; number <= MJ_WHITE; number++)
+        for (int sub = 0; sub < 4; sub++)
+            tiles.push_back(MJ_TILE(MJ_DRAGON, number, sub));
+
+    for (std::size_t i = tiles.size() - 1; i > 0; --i)
+        std::swap(tiles[i], tiles[rng(i + 1)]);
+    return tiles;
+}
+
+class bench
+{
+public:
+    bench(bool tsv, char const *dir) : tsv(tsv), dir(dir)
+    {
+        glGenQueries(1, &query);
+        glClearColor(0.1f, 0.4f, 0.0f, 0.5f);
+
+        /* The first timer query of some drivers (llvmpipe) counts from the
+         * creation of the context, so one is wasted on an empty frame */
+        GLuint64 ignored;
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer2d::flush();
+        glEndQuery(GL_TIME_ELAPSED);
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ignored);
+    }
+
+    ~bench() { glDeleteQueries(1, &query); }
+
+    /**
+     * Play a round, the hands of the others hidden as in the client of the
+     * player 0.
+     */
+    void round(bool dump)
+    {
+        table t;
+        t.wall = shuffled_deck();
+        renderer2d::clear();
+        int s = 0;
+
+        for (int p = 0; p < NUM_PLAYERS; ++p)
+            for (int i = 0; i < HAND_SIZE; ++i)
+                mj_add_tile(&t.hands[p], seen_by(p, draw(t)));
+        frame([&] {
+            for (int p = 0; p < NUM_PLAYERS; ++p)
+                renderer2d::submit(t.hands[p], p);
+            renderer2d::submit(0, {10.f, 10.f}, 0);
+            renderer2d::submit_calls();
+        }, s);
+        end_scene(s++, dump);
+
+        int player = 0;
+        for (int turn = 0; turn < TURNS; ++turn)
+        {
+            mj_tile const drawn = draw(t);
+            mj_add_tile(&t.hands[player], seen_by(player, drawn));
+            frame([&] { renderer2d::submit(t.hands[player], player); }, s);
+
+            /* The others can only discard what they drew, unseen */
+            bool const tsumogiri = player != 0 || rng(3) == 0;
+            mj_tile const tile = tsumogiri ? drawn : t.hands[0].tiles[rng(t.hands[0].size)];
+            remove(t.hands[player], tile);
+            t.discards[player].push_back(tsumogiri ? tile | renderer2d::TSUMOGIRI_FLAG : tile);
+            frame([&] {
+                renderer2d::submit(t.hands[player], player);
+                renderer2d::submit(t.discards[player], player);
+            }, s);
+
+            int const caller = (player + 1 + rng(3)) % NUM_PLAYERS;
+            if (!rng(12) && t.melds[caller].size < MJ_MAX_TRIPLES_IN_HAND && t.hands[caller].size > 2)
+            {
+                t.discards[player].pop_back();
+                mj_tile const first = tile ^ 0b01, second = tile ^ 0b10;
+                remove(t.hands[caller], seen_by(caller, first));
+                remove(t.hands[caller], seen_by(caller, second));
+                mj_add_meld(&t.melds[caller], MJ_CALL_TRIPLE(MJ_OPEN_TRIPLE(
+                    MJ_TRIPLE(tile, first, second)), (player - caller) & 3));
+                frame([&] {
+                    renderer2d::submit(t.discards[player], player);
+                    renderer2d::submit(t.hands[caller], caller);
+                    renderer2d::submit(t.melds[caller], caller);
+                }, s);
+                player = caller;
+            }
+            player = (player + 1) % NUM_PLAYERS;
+
+            if (turn + 1 == SCENES[s].last_turn)
+                end_scene(s++, dump);
+        }
+
+        frame([&] { renderer2d::submit(8000, {10.f, 10.f}, 0); }, s - 1);
+    }
+
+    void print(int rounds) const
+    {
+        if (!tsv)
+            printf("%-10s %8s %12s %12s %12s %12s\n",
+                "scene", "frames", "submit us", "gpu us", "frame us", "max frame us");
+        for (std::size_t s = 0; s < SCENES.size(); ++s)
+        {
+            auto const &st = results[s];
+            int const n = std::max(st.frames, 1);
+            if (tsv)
+                printf("%s\t%d\t%.2f\t%.2f\t%.2f\t%.2f\n", SCENES[s].name, st.frames / rounds,
+                    st.submit_us / n, st.gpu_us / n, st.frame_us / n, st.max_frame_us);
+            else
+                printf("%-10s %8d %12.2f %12.2f %12.2f %12.2f\n", SCENES[s].name, st.frames / rounds,
+                    st.submit_us / n, st.gpu_us / n, st.frame_us / n, st.max_frame_us);
+        }
+    }
+
+private:
+    bool tsv;
+    char const *dir;
+    GLuint query;
+    std::array<stats, SCENES.size()> results {};
+
+    static mj_tile draw(table &t)
+    {
+        mj_tile const tile = t.wall.back();
+        t.wall.pop_back();
+        return tile;
+    }
+
+    /* A tile of a player as the client of player 0 knows it */
+    static mj_tile seen_by(int player, mj_tile tile)
+    {
+        return player == 0 ? tile : MJ_INVALID_TILE;
+    }
+
+    /* Remove a tile from a hand, or any tile if it is not known, like the client */
+    static void remove(mj_hand &hand, mj_tile tile)
+    {
+        if (!mj_discard_tile(&hand, tile))
+            --hand.size;
+    }
+
+    template <typename Submit>
+    void frame(Submit const &submit, int s)
+    {
+        auto const start = clock_type::now();
+        submit();
+        renderer2d::publish();
+        auto const submitted = clock_type::now();
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer2d::flush();
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        auto const end = clock_type::now();
+
+        GLuint64 gpu_ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpu_ns);
+
+        auto &st = results[s];
+        double const frame_us = micros(end - start);
+        ++st.frames;
+        st.submit_us += micros(submitted - start);
+        st.gpu_us += gpu_ns / 1e3;
+        st.frame_us += frame_us;
+        st.max_frame_us = std::max(st.max_frame_us, frame_us);
+    }
+
+    /* Write the frame last drawn, which is bottom up in OpenGL */
+    void end_scene(int s, bool dump) const
+    {
+        if (!dump || !dir)
+            return;
+
+        constexpr int W = renderer2d::WINDOW_WIDTH, H = renderer2d::WINDOW_HEIGHT;
+        std::vector<unsigned char> pixels(W * H * 4);
+        glReadPixels(0, 0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        std::string const path = std::string(dir) + "/" + SCENES[s].name + ".png";
+        cimg_library::CImg<unsigned char>(pixels.data(), 4, W, H, 1, true)
+            .get_permute_axes("yzcx").mirror('y').save_png(path.c_str());
+    }
+
+    static double micros(clock_type::duration d)
+    {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+};
+
+int main(int argc, char **argv)
+{
+    unsigned long long seed = 0x5eed;
+    int rounds = 10;
+    char const *dir = nullptr;
+    bool tsv = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            rounds = std::max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "-t"))
+            tsv = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s seed] [-r rounds] [-o dir] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    renderer2d::headless = true;
+    if (!renderer2d::window_ptr())
+        return 1;
+
+    bench b(tsv, dir);
+    rng_state = seed;
+    for (int r = 0; r < rounds; ++r)
+        b.round(r == 0);
+    b.print(rounds);
+    return 0;
+}
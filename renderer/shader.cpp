@@ -124,3 +124,50 @@ void shader::uniform(char const *name, glm::mat4 const &value, bool transpose)
 {
     glUniformMatrix4fv(locate_uniform(name), 1, transpose, glm::value_ptr(value));
 }
+
+void shader::uniform(int location, glm::mat4 const &value, bool transpose)
+{
+    glUniformMatrix4fv(location, 1, transpose, glm::value_ptr(value));
+}
+
+void shader::check_block(char const *name, unsigned int binding, std::size_t size) const
+{
+#ifndef NDEBUG
+    unsigned int const index = glGetUniformBlockIndex(program_id, name);
+    if (index == GL_INVALID_INDEX)
+        throw std::runtime_error("uniform block not found: " + std::string(name));
+
+    int block_binding, block_size;
+    glGetActiveUniformBlockiv(program_id, index, GL_UNIFORM_BLOCK_BINDING, &block_binding);
+    glGetActiveUniformBlockiv(program_id, index, GL_UNIFORM_BLOCK_DATA_SIZE, &block_size);
+    if (static_cast<unsigned int>(block_binding) != binding)
+        throw std::runtime_error("uniform block at another binding: " + std::string(name));
+    if (static_cast<std::size_t>(block_size) != size)
+        throw std::runtime_error("uniform block of another size: " + std::string(name));
+#endif
+}
+
+void shader::check_location(char const *name, int location) const
+{
+#ifndef NDEBUG
+    if (glGetUniformLocation(program_id, name) != location)
+        throw std::runtime_error("uniform at another location: " + std::string(name));
+#endif
+}
+
+uniform_buffer::uniform_buffer(unsigned int binding, std::size_t size)
+{
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &buffer_id);
+    glNamedBufferStorage(buffer_id, size, nullptr, flags);
+    mapped = glMapNamedBufferRange(buffer_id, 0, size, flags);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer_id);
+}
+
+uniform_buffer::~uniform_buffer() noexcept
+{
+    if (!buffer_id)
+        return;
+    glUnmapNamedBuffer(buffer_id);
+    glDeleteBuffers(1, &buffer_id);
+}
@@ -1,6 +1,7 @@
 #ifndef MJ_RENDERER_SHADER_HPP
 #define MJ_RENDERER_SHADER_HPP
 
+#include <cstddef>
 #include <unordered_map>
 #include <string>
 #include <glm/glm.hpp>
@@ -26,6 +27,21 @@ public:
     void uniform(char const *name, glm::vec4 const &value);
     void uniform(char const *name, glm::mat4 const &value, bool transpose=false);
 
+    /* Set a uniform at its fixed location, layout(location = ...) */
+    static void uniform(int location, glm::mat4 const &value, bool transpose=false);
+
+    /**
+     * @brief Check, in debug builds, that a uniform block of the program has
+     * the binding and size of the struct it is written from.
+     */
+    void check_block(char const *name, unsigned int binding, std::size_t size) const;
+
+    /**
+     * @brief Check, in debug builds, that a uniform of the program is at the
+     * location it is set at.
+     */
+    void check_location(char const *name, int location) const;
+
 private:
     unsigned int program_id {};
     std::unordered_map<std::string, int> uniform_cache;
@@ -35,4 +51,41 @@ private:
     int locate_uniform(char const *name);
 };
 
+/**
+ * @brief A uniform buffer at a fixed binding point, persistently mapped, so
+ * its uniforms are set by plain stores.
+ *
+ * @details The mapping is coherent: what is stored is seen by the next draw
+ * calls. It must not be stored to while a draw that reads it may still run.
+ */
+class uniform_buffer
+{
+public:
+    uniform_buffer(unsigned int binding, std::size_t size);
+    ~uniform_buffer() noexcept;
+
+    uniform_buffer(uniform_buffer const &) = delete;
+    uniform_buffer &operator=(uniform_buffer const &) = delete;
+
+protected:
+    void *mapped {};
+
+private:
+    unsigned int buffer_id {};
+};
+
+/**
+ * A uniform buffer with the layout of Block, which must match the std140
+ * block of the shaders (see shader::check_block).
+ */
+template<typename Block>
+class uniform_block : public uniform_buffer
+{
+public:
+    explicit uniform_block(unsigned int binding) : uniform_buffer(binding, sizeof(Block)) {}
+
+    Block *operator->() noexcept { return static_cast<Block *>(mapped); }
+    Block &operator*() noexcept { return *static_cast<Block *>(mapped); }
+};
+
 #endif
\ No newline at end of file
@@ -1,62 +1,134 @@
 #include "text.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 #ifndef NDEBUG
 #include <stdexcept>
 #endif
 
-std::vector<quad2d> text::render_num(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const
+namespace
 {
-    std::vector<quad2d> quads;
-
-    // count number of digits
-    int digits = 0;
-    int n = num;
-    while (n) {
-        n /= 10;
-        ++digits;
-    }
 
-    offset += h_sz * static_cast<float>(digits - 1);
+/* The texture coordinates of a glyph */
+struct glyph_uv
+{
+    float left, right, top, bottom;
+};
+
+constexpr std::array<glyph_uv, text::NUM_GLYPHS> GLYPHS = []() {
+    std::array<glyph_uv, text::NUM_GLYPHS> glyphs {};
+    for (int d = 0; d < 10; ++d)
+        glyphs[d] = { d * text::DIGITS_WIDTH, (d + 1) * text::DIGITS_WIDTH,
+            text::DIGITS_TOP, text::DIGITS_BOT };
+    for (int c = 0; c < 6; ++c)
+        glyphs[text::CALL_GLYPHS + c] = { c * text::CALLS_WIDTH, (c + 1) * text::CALLS_WIDTH,
+            text::CALLS_TOP, text::CALLS_BOT };
+    glyphs[text::DASH_GLYPH] = { text::DASH_LEFT, text::DASH_RIGHT,
+        text::CALLS_TOP, text::CALLS_BOT };
+    return glyphs;
+}();
+
+/* The characters of the calls in UTF-8, in the order of game_call */
+constexpr std::array<char const *, 6> CALL_CHARACTERS {
+    "\xe6\xa0\x84", "\xe6\x91\xb8", "\xe7\x9b\xb4", "\xe6\xa7\x93", "\xe7\xa2\xb0", "\xe5\x90\x83" };
 
-    while (num)
+}
+
+text::glyph_run text::format(int num) noexcept
+{
+    glyph_run run;
+    if (num < 0)
+        run.glyphs[run.size++] = DASH_GLYPH;
+
+    /* Through unsigned, as -INT_MIN is not an int */
+    unsigned magnitude = num < 0 ? 0u - static_cast<unsigned>(num) : num;
+    std::array<unsigned char, MAX_DIGITS> reversed;
+    std::size_t digits = 0;
+    do
     {
-        int digit = num % 10;
-        num /= 10;
-        auto quad = render_digit(digit, offset, h_sz, v_sz);
-        offset -= h_sz;
-        quads.push_back(quad);
-    }
+        reversed[digits++] = magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
 
-    return quads;
+    while (digits)
+        run.glyphs[run.size++] = reversed[--digits];
+    return run;
 }
 
-quad2d text::render_call(game_call call, glm::vec2 offset, glm::vec2 sz) const
+text::glyph_run text::format(char const *str) noexcept
 {
-    quad2d quad;
+    glyph_run run;
+    while (*str && run.size < MAX_RUN)
+    {
+        if (*str >= '0' && *str <= '9')
+        {
+            run.glyphs[run.size++] = *str++ - '0';
+            continue;
+        }
+        if (*str == '-')
+        {
+            run.glyphs[run.size++] = DASH_GLYPH;
+            ++str;
+            continue;
+        }
+
+        auto const call = std::find_if(CALL_CHARACTERS.begin(), CALL_CHARACTERS.end(),
+            [str](char const *c) { return !std::strncmp(str, c, std::strlen(c)); });
+        if (call != CALL_CHARACTERS.end())
+            run.glyphs[run.size++] = CALL_GLYPHS + (call - CALL_CHARACTERS.begin());
+
+        /* Skip the character, and its continuation bytes */
+        do
+            ++str;
+        while ((*str & 0xc0) == 0x80);
+    }
+    return run;
+}
 
-    quad.tex_index(bound_slot);
-    quad.tint(glm::vec4(1.0f));
+std::size_t text::render(glyph_run const &run, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz,
+    quad2d *out) const
+{
+    for (std::size_t i = 0; i < run.size; ++i)
+    {
+        out[i] = render_glyph(run.glyphs[i], offset, h_sz, v_sz);
+        offset += h_sz;
+    }
+    return run.size;
+}
 
-    quad.tl.position = offset;
-    quad.br.position = offset + sz;
-    quad.tr.position = { quad.br.x, quad.tl.y };
-    quad.bl.position = { quad.tl.x, quad.br.y };
+std::size_t text::render_num(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz,
+    quad2d *out) const
+{
+    auto &entry = num_cache[(static_cast<unsigned>(num) * 2654435761u) >> 29];
+    bool const hit = entry.size && entry.num == num && entry.offset == offset
+        && entry.h_sz == h_sz && entry.v_sz == v_sz;
+    if (!hit)
+    {
+        entry.num = num;
+        entry.offset = offset;
+        entry.h_sz = h_sz;
+        entry.v_sz = v_sz;
+        entry.size = render(format(num), offset, h_sz, v_sz, entry.quads.data());
+    }
 
-    quad.tl.u = quad.bl.u = static_cast<float>(call) * CALLS_WIDTH;
-    quad.tr.u = quad.br.u = (static_cast<float>(call) + 1.f) * CALLS_WIDTH;
-    quad.tl.v = quad.tr.v = CALLS_TOP;
-    quad.bl.v = quad.br.v = CALLS_BOT;
+    std::copy_n(entry.quads.begin(), entry.size, out);
+    return entry.size;
+}
 
-    return quad;
+quad2d text::render_call(game_call call, glm::vec2 offset, glm::vec2 sz) const
+{
+    return render_glyph(CALL_GLYPHS + static_cast<int>(call), offset,
+        { sz.x, 0.f }, { 0.f, sz.y });
 }
 
-quad2d text::render_digit(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const
+quad2d text::render_glyph(int glyph, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const
 {
     quad2d quad;
 
 #ifndef NDEBUG
     if (bound_slot < 0)
-        throw std::runtime_error("text::render_digit: texture not bound.");
+        throw std::runtime_error("text::render_glyph: texture not bound.");
 #endif
 
     quad.tex_index(bound_slot);
@@ -67,10 +139,11 @@ quad2d text::render_digit(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v
     quad.bl.position = offset + v_sz;
     quad.br.position = offset + h_sz + v_sz;
 
-    quad.tl.u = quad.bl.u = num * DIGITS_WIDTH;
-    quad.tr.u = quad.br.u = (num + 1) * DIGITS_WIDTH;
-    quad.tl.v = quad.tr.v = DIGITS_TOP;
-    quad.bl.v = quad.br.v = DIGITS_BOT;
+    auto const &uv = GLYPHS[glyph];
+    quad.tl.u = quad.bl.u = uv.left;
+    quad.tr.u = quad.br.u = uv.right;
+    quad.tl.v = quad.tr.v = uv.top;
+    quad.bl.v = quad.br.v = uv.bottom;
 
     return quad;
 }
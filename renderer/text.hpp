@@ -4,6 +4,20 @@
 #include "texture.hpp"
 #include "mesh.hpp"
 
+#include <array>
+#include <cstddef>
+
+/**
+ * @brief The text atlas: the digits, the characters of the calls and a dash.
+ *
+ * @details Text is rendered from glyph runs, the glyphs of a string or a
+ * number found once, so rendering is only writing their quads. The last
+ * numbers rendered are cached with their quads, by number and layout, as a
+ * score is rendered again with the same layout until it changes.
+ *
+ * The cache is not synchronized: render_num must be called from one thread,
+ * the game thread for renderer2d.
+ */
 class text : public texture
 {
 public:
@@ -19,23 +33,76 @@ public:
         DIGITS_WIDTH    = 0.10f,
         CALLS_TOP       = 0.45f,
         CALLS_BOT       = 1.00f,
-        CALLS_WIDTH     = 0.15f;
+        CALLS_WIDTH     = 0.15f,
+        DASH_LEFT       = 0.90f,
+        DASH_RIGHT      = 1.00f;
+
+    /* The glyphs of the atlas: the digits, the calls, then the dash */
+    static constexpr int
+        CALL_GLYPHS     = 10,
+        DASH_GLYPH      = 16,
+        NUM_GLYPHS      = 17;
+
+    /* The glyphs of the longest int, with its sign */
+    static constexpr int MAX_DIGITS = 11;
+
+    /* The longest glyph run */
+    static constexpr std::size_t MAX_RUN = 32;
+
+    /**
+     * The glyphs of a string, in order.
+     */
+    struct glyph_run
+    {
+        std::array<unsigned char, MAX_RUN> glyphs;
+        std::size_t size = 0;
+    };
 
 public:
     explicit text(char const *path) : texture(path) {}
 
+    /**
+     * @return The glyphs of a number, without leading zeros, with a dash if
+     * it is negative.
+     */
+    static glyph_run format(int num) noexcept;
+
+    /**
+     * @return The glyphs of a UTF-8 string, of which only the digits, '-'
+     * and the characters of the calls (栄摸直槓碰吃) are in the atlas. The
+     * other characters are skipped, and the string is cut at MAX_RUN glyphs.
+     */
+    static glyph_run format(char const *str) noexcept;
+
+    /**
+     * Write the quads of a glyph run at a given offset, with a given size per
+     * glyph.
+     *
+     * @param offset The position of the top left corner of the first glyph.
+     * @param h_sz From the left to the right of a glyph, and to the next one.
+     * @param v_sz From the top to the bottom of a glyph.
+     * @param out Where to write the quads, room for run.size.
+     *
+     * @return The number of quads written.
+     */
+    std::size_t render(glyph_run const &run, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz,
+        quad2d *out) const;
+
     /**
      * Get the vertices to render a number (without leading zeros) at a
-     * given offset, with a given size per digit.
+     * given offset, with a given size per digit, from the cache if it was
+     * rendered recently with the same layout.
      *
      * @param number The number to render.
      * @param offset The position of the top left corner of the first digit.
      * @param size The size of each digit. Could be negative to control the
      * orientation of the number.
+     * @param out Where to write the quads, room for MAX_DIGITS.
      *
-     * @return The vertices to render the number as a vector of quad2ds.
+     * @return The number of quads written.
      */
-    std::vector<quad2d> render_num(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const;
+    std::size_t render_num(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz,
+        quad2d *out) const;
 
     /**
      * Get the vertices to render a japanese character for a specified mahjong
@@ -51,7 +118,20 @@ public:
     quad2d render_call(game_call call, glm::vec2 offset, glm::vec2 sz) const;
 
 private:
-    quad2d render_digit(int num, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const;
+    /* The numbers rendered last, in slots by hash of the number */
+    static constexpr std::size_t NUM_CACHE_SIZE = 8;
+
+    struct cached_num
+    {
+        int num;
+        glm::vec2 offset, h_sz, v_sz;
+        std::size_t size = 0;
+        std::array<quad2d, MAX_DIGITS> quads;
+    };
+
+    mutable std::array<cached_num, NUM_CACHE_SIZE> num_cache {};
+
+    quad2d render_glyph(int glyph, glm::vec2 offset, glm::vec2 h_sz, glm::vec2 v_sz) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -7,8 +7,19 @@
 #include <GL/glew.h>
 #include <CImg.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
  * @brief exception that is thrown when there is some problem preventing the
@@ -26,46 +37,251 @@ private:
     std::string msg;
 };
 
-texture::texture(const char *path)
+namespace
+{
+
+/**
+ * The header of a cache file, followed by the levels from the largest, each
+ * one RGBA and tightly packed. The PNG it was made from is known by its size
+ * and modification time.
+ */
+struct cache_header
+{
+    char            magic[4];
+    std::uint32_t   version;
+    std::uint32_t   width;
+    std::uint32_t   height;
+    std::uint32_t   levels;
+    std::uint32_t   reserved;
+    std::uint64_t   source_size;
+    std::int64_t    source_mtime;
+};
+
+constexpr char CACHE_MAGIC[4] = { 'W', 'Z', 'T', 'X' };
+constexpr std::uint32_t CACHE_VERSION = 1;
+
+std::size_t level_size(cache_header const &h, std::uint32_t level)
+{
+    std::size_t const w = std::max(h.width >> level, 1u), ht = std::max(h.height >> level, 1u);
+    return w * ht * texture::BPP;
+}
+
+std::size_t levels_size(cache_header const &h)
+{
+    std::size_t size = 0;
+    for (std::uint32_t l = 0; l < h.levels; ++l)
+        size += level_size(h, l);
+    return size;
+}
+
+/**
+ * The image of a texture and its mipmaps, mapped from the cache or decoded.
+ */
+class texture_image
 {
-    cimg_library::CImg<data_type> img(path);
-    if (img.spectrum() != BPP)
-        throw texture_loading_error("Texture image must be RGBA.");
+public:
+    cache_header header {};
 
-    data_type *tex = new data_type[img.width() * img.height() * BPP];
-    data_type *tex_ptr = tex;
+    texture_image() = default;
+    texture_image(texture_image const &) = delete;
+    texture_image(texture_image &&other) noexcept
+        : header(other.header), decoded(std::move(other.decoded)),
+          mapping(std::exchange(other.mapping, nullptr)), mapping_size(other.mapping_size)
+    {}
+
+    ~texture_image() noexcept
+    {
+        if (mapping)
+            munmap(mapping, mapping_size);
+    }
 
-    auto start = std::chrono::high_resolution_clock::now();
+    texture::data_type const *levels() const noexcept
+    {
+        if (mapping)
+            return static_cast<texture::data_type const *>(mapping) + sizeof(cache_header);
+        return decoded.data();
+    }
 
-    for (int y{}; y < img.height(); ++y)
+    /**
+     * @brief Map the cache, if it was made from the PNG as it is now.
+     */
+    bool map(std::string const &cache_path, struct stat const &source)
     {
-        for (int x{}; x < img.width(); ++x)
+        int const fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && (std::size_t)st.st_size >= sizeof(cache_header);
+        if (ok)
         {
-            for (int c{}; c < BPP; ++c)
+            mapping_size = st.st_size;
+            mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (!ok)
+                mapping = nullptr;
+        }
+        close(fd);
+        if (!ok)
+            return false;
+
+        std::memcpy(&header, mapping, sizeof header);
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0
+            || header.version != CACHE_VERSION
+            || header.source_size != (std::uint64_t)source.st_size
+            || header.source_mtime != mtime(source)
+            || sizeof(cache_header) + levels_size(header) != mapping_size)
+        {
+            munmap(mapping, mapping_size);
+            mapping = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Decode the PNG and make the mipmaps, each level a 2x2 box filter
+     * of the previous one.
+     */
+    void decode(char const *path, struct stat const &source)
+    {
+        cimg_library::CImg<texture::data_type> img(path);
+        if (img.spectrum() != texture::BPP)
+            throw texture_loading_error("Texture image must be RGBA.");
+        /* From planes of channels to interleaved pixels */
+        img.permute_axes("cxyz");
+
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC);
+        header.version = CACHE_VERSION;
+        header.width = img.height();
+        header.height = img.depth();
+        header.levels = 1;
+        while ((header.width | header.height) >> header.levels)
+            ++header.levels;
+        header.source_size = source.st_size;
+        header.source_mtime = mtime(source);
+
+        decoded.resize(levels_size(header));
+        std::memcpy(decoded.data(), img.data(), level_size(header, 0));
+
+        texture::data_type *src = decoded.data();
+        for (std::uint32_t l = 1; l < header.levels; ++l)
+        {
+            std::uint32_t const sw = std::max(header.width >> (l - 1), 1u);
+            std::uint32_t const sh = std::max(header.height >> (l - 1), 1u);
+            std::uint32_t const w = std::max(sw / 2, 1u), h = std::max(sh / 2, 1u);
+            texture::data_type *dst = src + level_size(header, l - 1);
+            for (std::uint32_t y = 0; y < h; ++y)
             {
-                *tex_ptr++ = img(x, y, 0, c);
+                std::uint32_t const y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                for (std::uint32_t x = 0; x < w; ++x)
+                {
+                    std::uint32_t const x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                    for (int c = 0; c < texture::BPP; ++c)
+                    {
+                        unsigned const sum =
+                            src[(y0 * sw + x0) * texture::BPP + c] + src[(y0 * sw + x1) * texture::BPP + c] +
+                            src[(y1 * sw + x0) * texture::BPP + c] + src[(y1 * sw + x1) * texture::BPP + c];
+                        dst[(y * w + x) * texture::BPP + c] = (sum + 2) / 4;
+                    }
+                }
             }
+            src = dst;
         }
     }
 
-    // time
-    auto end = std::chrono::high_resolution_clock::now();
-    std::cout << "Texture loading for " << path << " took "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-              << "ms" << std::endl;
+    /**
+     * @brief Write the cache, to a temporary file renamed over the old one so
+     * a reader never maps half a file.
+     */
+    bool write(std::string const &cache_path) const
+    {
+        std::string const tmp_path = cache_path + ".tmp";
+        std::FILE *f = std::fopen(tmp_path.c_str(), "wb");
+        if (!f)
+            return false;
+        bool ok = std::fwrite(&header, sizeof header, 1, f) == 1
+            && std::fwrite(decoded.data(), 1, decoded.size(), f) == decoded.size();
+        ok = std::fclose(f) == 0 && ok;
+        if (ok && std::rename(tmp_path.c_str(), cache_path.c_str()) == 0)
+            return true;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+private:
+    std::vector<texture::data_type> decoded;
+    void *mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    static std::int64_t mtime(struct stat const &st) noexcept
+    {
+        return (std::int64_t)st.st_mtim.tv_sec * 1'000'000'000 + st.st_mtim.tv_nsec;
+    }
+};
+
+struct stat source_stat(char const *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        throw texture_loading_error(std::string("Cannot open ") + path);
+    return st;
+}
+
+}
+
+bool texture::bake(const char *path)
+{
+    texture_image image;
+    image.decode(path, source_stat(path));
+    return image.write(std::string(path) + CACHE_SUFFIX);
+}
+
+/**
+ * The levels are uploaded straight from the mapping of the cache. On a miss,
+ * the PNG is decoded and the cache is written for the next start, which may
+ * fail on a read-only asset directory, then the texture is just not cached.
+ */
+texture::texture(const char *path)
+{
+    [[maybe_unused]] auto const start = std::chrono::steady_clock::now();
+
+    struct stat const source = source_stat(path);
+    std::string const cache_path = std::string(path) + CACHE_SUFFIX;
+    texture_image image;
+    bool const cached = image.map(cache_path, source);
+    if (!cached)
+    {
+        image.decode(path, source);
+        if (!image.write(cache_path))
+            std::cerr << "Cannot write the texture cache " << cache_path << std::endl;
+    }
 
     glGenTextures(1, &tex_id);
     glBindTexture(GL_TEXTURE_2D, tex_id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.width(), img.height(), 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, tex);
+    auto const &h = image.header;
+    glTexStorage2D(GL_TEXTURE_2D, h.levels, GL_RGBA8, h.width, h.height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    data_type const *level = image.levels();
+    for (std::uint32_t l = 0; l < h.levels; ++l)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, std::max(h.width >> l, 1u),
+            std::max(h.height >> l, 1u), GL_RGBA, GL_UNSIGNED_BYTE, level);
+        level += level_size(h, l);
+    }
 
-    delete[] tex;
+#ifndef NDEBUG
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Texture loading for " << path << (cached ? " from its cache" : "")
+              << " took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+              << "ms" << std::endl;
+#endif
 }
 
 texture::~texture() noexcept
@@ -1,13 +1,30 @@
 #ifndef MJ_RENDERER_TEXTURE_HPP
 #define MJ_RENDERER_TEXTURE_HPP
 
+/**
+ * @brief An RGBA texture with its mipmaps, loaded from a PNG.
+ *
+ * @details Decoding a large PNG is slow, so the decoded image and its mipmaps
+ * are cached in a file next to it (the path followed by CACHE_SUFFIX), which
+ * is mapped and uploaded as is. The cache is rebuilt from the PNG when it is
+ * missing or older than the PNG, and can be built ahead of time by bake.
+ */
 class texture
 {
 public:
     static constexpr int BPP = 4;
     using data_type = unsigned char;
+
+    static constexpr char const *CACHE_SUFFIX = ".tex";
 public:
     explicit texture(const char *path);
+
+    /**
+     * @brief Decode a PNG and write its cache, without OpenGL.
+     *
+     * @return If the cache could be written.
+     */
+    static bool bake(const char *path);
     ~texture() noexcept;
 
     void bind(int tex_slot) noexcept;
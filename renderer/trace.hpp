@@ -0,0 +1,111 @@
+#ifndef MJ_RENDERER_TRACE_HPP
+#define MJ_RENDERER_TRACE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief A trace of the frames of the render thread, to check that it never
+ * waits on the game thread.
+ *
+ * @details Each frame records how long the flush and the buffer swap took, and
+ * for a frame that shows a new list, how long ago the game thread published
+ * it and how many quads were uploaded. The last CAPACITY frames are kept and
+ * written as tab separated values by dump.
+ */
+class frame_trace
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static constexpr std::size_t CAPACITY = 1 << 14;
+
+    struct sample
+    {
+        clock_type::time_point  start;
+        float                   flush_us;
+        float                   swap_us;
+        /* From the publishing of the list to its flush, 0 for an old list */
+        float                   latency_us;
+        std::size_t             uploaded_quads;
+    };
+
+public:
+    frame_trace() { samples.reserve(CAPACITY); }
+
+    void begin_frame() noexcept { current.start = clock_type::now(); }
+
+    /**
+     * @param fresh If the flush uploaded a newly published list.
+     * @param published When the list that was drawn was published.
+     * @param uploaded_quads The quads written to the vertex buffer.
+     */
+    void flushed(bool fresh, clock_type::time_point published, std::size_t uploaded_quads) noexcept
+    {
+        auto const now = clock_type::now();
+        current.flush_us = micros(now - current.start);
+        current.latency_us = fresh ? micros(now - published) : 0.f;
+        current.uploaded_quads = uploaded_quads;
+        flush_end = now;
+    }
+
+    void end_frame()
+    {
+        current.swap_us = micros(clock_type::now() - flush_end);
+        if (samples.size() < CAPACITY)
+            samples.push_back(current);
+        else
+            samples[next] = current;
+        next = (next + 1) % CAPACITY;
+    }
+
+    /**
+     * @brief Write the frames, oldest first, and a summary on stdout.
+     *
+     * @return If the file could be written.
+     */
+    bool dump(char const *path) const
+    {
+        std::FILE *f = std::fopen(path, "w");
+        if (!f)
+            return false;
+
+        std::size_t const first = samples.size() < CAPACITY ? 0 : next;
+        float max_flush = 0.f, max_latency = 0.f;
+        std::size_t uploads = 0, uploaded_quads = 0;
+        std::fprintf(f, "start_us\tflush_us\tswap_us\tlatency_us\tuploaded_quads\n");
+        for (std::size_t i = 0; i < samples.size(); ++i)
+        {
+            auto const &s = samples[(first + i) % samples.size()];
+            std::fprintf(f, "%.1f\t%.1f\t%.1f\t%.1f\t%zu\n",
+                micros(s.start - samples[first].start), s.flush_us, s.swap_us, s.latency_us,
+                s.uploaded_quads);
+            max_flush = std::max(max_flush, s.flush_us);
+            max_latency = std::max(max_latency, s.latency_us);
+            uploads += s.latency_us > 0.f;
+            uploaded_quads += s.uploaded_quads;
+        }
+        std::fclose(f);
+
+        std::printf("%zu frames, longest flush %.1f us, longest publish to flush %.1f us, "
+            "%.1f quads uploaded per new frame\n", samples.size(), max_flush, max_latency,
+            uploads ? (double)uploaded_quads / uploads : 0.0);
+        return true;
+    }
+
+private:
+    std::vector<sample>     samples;
+    std::size_t             next = 0;
+    sample                  current {};
+    clock_type::time_point  flush_end;
+
+    static float micros(clock_type::duration d) noexcept
+    {
+        return std::chrono::duration<float, std::micro>(d).count();
+    }
+};
+
+#endif
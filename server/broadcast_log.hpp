@@ -0,0 +1,122 @@
+#ifndef MJ_SERVER_BROADCAST_LOG_HPP
+#define MJ_SERVER_BROADCAST_LOG_HPP
+
+#include "utils/message.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief The broadcast_log class is a ring of the last CAPACITY messages
+ * broadcast by a game, with the time they were broadcast.
+ *
+ * @details There is one writer, the game thread, for which appending is a
+ * few stores whatever the number of readers. Readers keep their own cursor
+ * (the sequence number of the next message) and never block the writer: a
+ * slot is guarded by a sequence stamp like a seqlock, so a reader that was
+ * lapped by the writer finds out instead of reading the newer message.
+ */
+class broadcast_log
+{
+public:
+    using clock_type    = std::chrono::steady_clock;
+    using sequence_type = std::uint64_t;
+
+    static constexpr std::size_t CAPACITY = 4096;
+
+    struct entry
+    {
+        msg::buffer             data;
+        clock_type::time_point  time;
+    };
+
+public:
+    broadcast_log() = default;
+    broadcast_log(broadcast_log const &) = delete;
+    broadcast_log &operator=(broadcast_log const &) = delete;
+
+    /**
+     * @brief Append a message. Only the game thread may call this.
+     */
+    void append(msg::buffer const &data) noexcept
+    {
+        sequence_type const seq = next.load(std::memory_order_relaxed);
+        slot &s = slots[seq % CAPACITY];
+
+        s.stamp.store(WRITING, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.payload.store(pack(data), std::memory_order_relaxed);
+        s.stamp.store(seq, std::memory_order_release);
+
+        next.store(seq + 1, std::memory_order_release);
+    }
+
+    /**
+     * @return The sequence number of the next message to be appended.
+     */
+    sequence_type end() const noexcept { return next.load(std::memory_order_acquire); }
+
+    /**
+     * @return The oldest sequence number still in the ring.
+     */
+    sequence_type begin() const noexcept
+    {
+        sequence_type const e = end();
+        return e > CAPACITY ? e - CAPACITY : 0;
+    }
+
+    /**
+     * @brief Read the message with the given sequence number.
+     *
+     * @return The message, or an empty optional if it was overwritten (or
+     * not appended yet).
+     */
+    std::optional<entry> read(sequence_type seq) const noexcept
+    {
+        slot const &s = slots[seq % CAPACITY];
+        if (s.stamp.load(std::memory_order_acquire) != seq)
+            return std::nullopt;
+        std::uint64_t const payload = s.payload.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.stamp.load(std::memory_order_relaxed) != seq)
+            return std::nullopt;
+        return unpack(payload);
+    }
+
+private:
+    static constexpr sequence_type WRITING = ~sequence_type{0};
+
+    /* The 3 bytes of the message, then the time in microseconds since epoch */
+    struct slot
+    {
+        std::atomic<sequence_type> stamp   { WRITING };
+        std::atomic<std::uint64_t> payload { 0 };
+    };
+
+    std::array<slot, CAPACITY>  slots;
+    std::atomic<sequence_type>  next    { 0 };
+    clock_type::time_point      epoch   { clock_type::now() };
+
+    std::uint64_t pack(msg::buffer const &data) const noexcept
+    {
+        auto const us = std::chrono::duration_cast<std::chrono::microseconds>(
+            clock_type::now() - epoch).count();
+        return (data[0] & 0xffull) | (data[1] & 0xffull) << 8 | (data[2] & 0xffull) << 16
+            | static_cast<std::uint64_t>(us) << 24;
+    }
+
+    entry unpack(std::uint64_t payload) const noexcept
+    {
+        return {
+            { static_cast<char>(payload), static_cast<char>(payload >> 8),
+              static_cast<char>(payload >> 16) },
+            epoch + std::chrono::microseconds(payload >> 24)
+        };
+    }
+
+    static_assert(msg::BUFFER_SIZE == 3, "a message must fit in a slot");
+};
+
+#endif
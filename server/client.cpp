@@ -1,30 +1,52 @@
 #include "client.hpp"
+#include "workers.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+/* The links received by serve_links, until their client takes them */
+struct pending_link
+{
+    shm::link                           link;
+    game_client::clock_type::time_point received;
+};
+
+std::mutex                                                  links_m;
+std::condition_variable                                     links_cv;
+std::unordered_map<game_client::id_type, pending_link>      links;
+
+}
 
 game_client::game_client(queue_type &shared_q, unsigned short &game_id, bool &as_player)
-    : uid(next_uid()), q(shared_q)
+    : uid(next_uid()), q(&shared_q)
 {
     acceptor.accept(socket);
-    std::string ip = socket.remote_endpoint().address().to_string();
-
-    if (online_mode)
-    {
-        if (connected_ips.find(ip) != connected_ips.end())
-        {
-            reject();
-            return;
-        }
-        else
-        {
-            connected_ips.insert(ip);
-        }
-    }
+    if (!register_ip())
+        return;
 
     msg::buffer conn_req, conn_id;
     try
     {
         socket.send(asio::buffer(msg::buffer_data(msg::header::your_id, uid), msg::BUFFER_SIZE));
         conn_req = recv(CONNECTION_TIMEOUT);
+        if (msg::type(conn_req) == msg::header::shared_memory)
+        {
+            if (!attach_link())
+            {
+                close();
+                return;
+            }
+            conn_req = recv(CONNECTION_TIMEOUT);
+        }
         conn_id  = recv(CONNECTION_TIMEOUT);
     }
     catch (const std::exception& e)
@@ -59,29 +81,103 @@ game_client::game_client(queue_type &shared_q, unsigned short &game_id, bool &as
         close();
         return;
     }
+}
 
+game_client::game_client(queue_type &shared_q, int native_socket, id_type id)
+    : uid(id), q(&shared_q)
+{
+    try
+    {
+        socket.assign(protocol::v4(), native_socket);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "game_client::game_client raised " << e.what() << std::endl;
+        ::close(native_socket);
+        return;
+    }
+    register_ip();
+}
+
+void game_client::start()
+{
     listener = std::thread(&game_client::listening, this);
-    pinger = std::thread(&game_client::pinging, this);
-    listener.detach();
-    pinger.detach();
+    ping_timer.arm(PING_FREQ);
+}
+
+bool game_client::register_ip()
+{
+    if (!online_mode)
+        return true;
+
+    auto ip_addr = ip();
+    if (!ip_addr || connected_ips.find(*ip_addr) != connected_ips.end())
+    {
+        reject();
+        return false;
+    }
+    connected_ips.insert(*ip_addr);
+    return true;
 }
 
 game_client::game_client(game_client &&other)
-    :   uid(other.uid), q(other.q),
+    :   uid(other.uid), q(other.q.load()),
         listener(std::move(other.listener)),
-        pinger  (std::move(other.pinger)),
-        socket  (std::move(other.socket))
-{}
+        socket  (std::move(other.socket)),
+        local_link(std::move(other.local_link))
+{
+    other.ping_timer.cancel();
+    other.pong_timer.cancel();
+    other.flush_timer.cancel();
+    {
+        std::scoped_lock lock(other.out_m);
+        outbox = other.outbox;
+        out_begin = std::exchange(other.out_begin, 0);
+        out_size = std::exchange(other.out_size, 0);
+    }
+    if (out_size)
+        flush_timer.arm(FLUSH_INTERVAL);
+    if (socket.is_open())
+        ping_timer.arm(PING_FREQ);
+}
 
 game_client::~game_client() noexcept
 {
+    ping_timer.cancel();
+    pong_timer.cancel();
+    flush_timer.cancel();
+    /* The listener uses the client until it returns: wake it from its
+     * blocking receive and wait for it before the client is freed. */
+    if (listener.joinable())
+    {
+        asio::error_code ec;
+        socket.shutdown(protocol::socket::shutdown_both, ec);
+        if (local_link)
+            local_link->close();
+        if (listener.get_id() != std::this_thread::get_id())
+            listener.join();
+        else
+            listener.detach();
+    }
     close();
 }
 
+void game_client::listen(bool reuse_port)
+{
+    acceptor.open(server_endpoint.protocol());
+    acceptor.set_option(protocol::acceptor::reuse_address(true));
+    if (reuse_port)
+        acceptor.set_option(game_client::reuse_port(true));
+    acceptor.bind(server_endpoint);
+    acceptor.listen();
+}
+
 game_client::id_type game_client::next_uid() noexcept
 {
-    static game_client::id_type counter = 8000;
-    return counter++;
+    static game_client::id_type counter = 8000 + workers::index();
+    id_type const uid = counter;
+    counter += workers::count();
+    return uid;
 }
 
 std::optional<std::string> game_client::ip() const noexcept
@@ -108,61 +204,279 @@ void game_client::close() noexcept
         if (ip_addr)
             connected_ips.erase(*ip_addr);
     }
+    if (local_link)
+        local_link->close();
     if (socket.is_open())
         socket.close();
 }
 
-void game_client::listening()
+/**
+ * The link of a local client is given before the join request, so the link
+ * waits for the uid the client was just told.
+ */
+bool game_client::attach_link()
 {
-    while (socket.is_open())
+    auto const worker = static_cast<unsigned short>(workers::index());
+    socket.send(asio::buffer(msg::buffer_data(msg::header::shared_memory, worker),
+        msg::BUFFER_SIZE));
+
+    std::unique_lock lock(links_m);
+    if (!links_cv.wait_for(lock, CONNECTION_TIMEOUT,
+        [this](){ return links.find(uid) != links.end(); }))
+        return false;
+
+    auto node = links.extract(uid);
+    local_link = std::move(node.mapped().link);
+    return true;
+}
+
+void game_client::serve_links()
+{
+    sockaddr_un addr;
+    socklen_t const length = shm::address(MJ_SERVER_DEFAULT_PORT, workers::index(), addr);
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), length) < 0
+        || ::listen(fd, SOMAXCONN) < 0)
     {
-        msg::buffer buf;
-        try
+        std::cerr << "Cannot take shared memory links: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    while (true)
+    {
+        int const conn = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0)
+            continue;
+        /* A peer that never sends its handles cannot hold the other links */
+        timeval const timeout { 1, 0 };
+        if (!shm::same_user(conn)
+            || setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0)
+        {
+            ::close(conn);
+            continue;
+        }
+        id_type id;
+        auto handles = shm::recv_handles(conn, &id, sizeof id);
+        ::close(conn);
+        if (!handles)
+            continue;
+
+        auto link = shm::link::adopt(shm::link::end::server, *handles);
+        if (!link)
+            continue;
+
+        auto const now = clock_type::now();
+        {
+            std::scoped_lock lock(links_m);
+            /* The links whose client gave up waiting */
+            std::erase_if(links, [now](auto const &entry)
+                { return now - entry.second.received > CONNECTION_TIMEOUT; });
+            links.insert_or_assign(id, pending_link { std::move(*link), now });
+        }
+        links_cv.notify_all();
+    }
+}
+
+bool game_client::receive(msg::buffer &buf)
+{
+    if (local_link)
+    {
+        /* The socket is only readable when the client left */
+        if (auto received = local_link->recv(socket.native_handle()))
         {
-            socket.receive(asio::buffer(buf, msg::BUFFER_SIZE));
+            buf = *received;
+            metrics::add(metrics::bytes_in, msg::BUFFER_SIZE);
+            metrics::add(metrics::messages_in);
+            return true;
         }
-        catch(const std::exception& e)
+        if (!local_link->is_open())
         {
-            std::cerr << "Listening thread raised: " << e.what() << std::endl;
             close();
+            return false;
         }
+    }
+
+    try
+    {
+        metrics::add(metrics::bytes_in,
+            socket.receive(asio::buffer(buf, msg::BUFFER_SIZE)));
+        metrics::add(metrics::messages_in);
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Listening thread raised: " << e.what() << std::endl;
+        close();
+        return false;
+    }
+}
+
+void game_client::listening()
+{
+    metrics::add(metrics::clients_opened);
+    while (socket.is_open())
+    {
+        msg::buffer buf;
+        if (!receive(buf))
+            break;
 
         if (msg::type(buf) == msg::header::ping)
-            ping_recv.notify_one();
+        {
+            pong_timer.cancel();
+            if (auto sent = ping_sent.exchange(0))
+            {
+                auto const round_trip = clock_type::now() -
+                    clock_type::time_point(clock_type::duration(sent));
+                rtt.record(round_trip);
+                server_rtt.record(round_trip);
+            }
+        }
         else
         {
 #ifndef NDEBUG
             std::cout << "Received from " << uid << ": " << (char)msg::type(buf) <<
             ' ' << msg::data<unsigned short>(buf) << std::endl;
 #endif
-            q.push_back({uid, buf});
+            q.load()->push_back({uid, buf});
         }
     }
+    metrics::add(metrics::clients_closed);
 }
 
 void game_client::pinging()
 {
-    while (socket.is_open())
+    if (!socket.is_open())
+        return;
+    /* Through the outbox and its non-blocking sends, so the wheel never waits
+     * on the socket. A ping the full outbox does not take is skipped, the
+     * slow consumer timeout deals with the client. */
+    auto const buf = msg::buffer_data(msg::header::ping, msg::PING);
+    pong_timer.arm(PING_TIMEOUT);
+    ping_sent = clock_type::now().time_since_epoch().count();
+    if (!send_some(buf.data(), msg::BUFFER_SIZE))
     {
-        std::this_thread::sleep_for(PING_FREQ);
-        send(msg::header::ping, msg::PING);
-        std::unique_lock ul(ping_m);
-        if (ping_recv.wait_for(ul, PING_TIMEOUT) == std::cv_status::timeout)
+        ping_sent = 0;
+        pong_timer.cancel();
+    }
+    ping_timer.arm(PING_FREQ);
+}
+
+std::size_t game_client::outbox_space() const noexcept
+{
+    std::scoped_lock lock(out_m);
+    return (outbox.size() - out_size) / msg::BUFFER_SIZE;
+}
+
+std::size_t game_client::queue(char const *data, std::size_t size, bool whole) noexcept
+{
+    std::unique_lock lock(out_m);
+    if (!socket.is_open())
+        return 0;
+
+    std::size_t const space = outbox.size() - out_size;
+    std::size_t const n = std::min(size, space - space % msg::BUFFER_SIZE);
+    if (whole && n < size)
+    {
+        lock.unlock();
+        metrics::add(metrics::outbox_dropped, size / msg::BUFFER_SIZE);
+        if (policy == slow_policy::disconnect)
         {
-            std::cerr << "Ping not replied by " << uid << " closing connection...\n";
+            std::cerr << "Outbox of " << uid << " overflowed, closing connection...\n";
+            metrics::add(metrics::slow_disconnects);
             close();
         }
+        else
+            dropped = true;
+        return 0;
     }
+
+    std::size_t const end = (out_begin + out_size) % outbox.size();
+    std::size_t const first = std::min(n, outbox.size() - end);
+    std::copy(data, data + first, outbox.begin() + end);
+    std::copy(data + first, data + n, outbox.begin());
+    out_size += n;
+    metrics::add(metrics::messages_out, n / msg::BUFFER_SIZE);
+
+    /* Otherwise the flush timer is armed already */
+    if (out_size == n)
+        flush();
+    return n;
 }
 
-void game_client::reject() noexcept
+/**
+ * The ring is written in at most two sends, the second one when it wraps.
+ */
+void game_client::flush() noexcept
 {
-    try
+    /* Messages are whole in the ring of a local client, only the link wraps */
+    while (local_link && out_size && socket.is_open())
     {
-        send(msg::header::reject, msg::REJECT);
+        msg::buffer buf;
+        std::copy_n(outbox.begin() + out_begin, msg::BUFFER_SIZE, buf.begin());
+        if (!local_link->send(buf))
+        {
+            if (local_link->is_open())
+                break;
+            out_size = 0;
+            socket.close();
+            return;
+        }
+        metrics::add(metrics::bytes_out, msg::BUFFER_SIZE);
+        out_begin = (out_begin + msg::BUFFER_SIZE) % outbox.size();
+        out_size -= msg::BUFFER_SIZE;
     }
-    catch(const std::exception& e)
-    {}
+
+    while (!local_link && out_size && socket.is_open())
+    {
+        std::size_t const chunk = std::min(out_size, outbox.size() - out_begin);
+        asio::error_code ec;
+        std::size_t const sent = socket.send(
+            asio::buffer(outbox.data() + out_begin, chunk), MSG_DONTWAIT, ec);
+        if (ec == asio::error::would_block || ec == asio::error::try_again)
+            break;
+        if (ec)
+        {
+            std::cerr << "Send failed: " << ec.message() << std::endl;
+            out_size = 0;
+            socket.close();
+            return;
+        }
+        metrics::add(metrics::bytes_out, sent);
+        out_begin = (out_begin + sent) % outbox.size();
+        out_size -= sent;
+        if (sent < chunk)
+            break;
+    }
+
+    if (!out_size)
+    {
+        out_begin = 0;
+        stalled_since = 0;
+        return;
+    }
+
+    auto const now = clock_type::now().time_since_epoch();
+    if (!stalled_since)
+        stalled_since = now.count();
+    else if (now - clock_type::duration(stalled_since) > SLOW_CONSUMER_TIMEOUT)
+    {
+        std::cerr << "Client " << uid << " stopped reading, closing connection...\n";
+        metrics::add(metrics::slow_disconnects);
+        out_size = 0;
+        socket.close();
+        return;
+    }
+    flush_timer.arm(FLUSH_INTERVAL);
+}
+
+/**
+ * The reject message is written right away by send, as the outbox of a
+ * client that is rejected is empty.
+ */
+void game_client::reject() noexcept
+{
+    send(msg::header::reject, msg::REJECT);
+    std::scoped_lock lock(out_m);
     if (socket.is_open())
         socket.close();
 }
@@ -171,10 +485,16 @@ bool game_client::online_mode;
 
 asio::io_context game_client::context;
 
+timer_wheel game_client::wheel;
+
 game_client::protocol::endpoint game_client::server_endpoint(
     game_client::protocol::v4(), MJ_SERVER_DEFAULT_PORT);
 
-game_client::protocol::acceptor game_client::acceptor(
-    game_client::context, game_client::server_endpoint);
+/* Opened by listen, after the process knows if it is a worker */
+game_client::protocol::acceptor game_client::acceptor(game_client::context);
 
 std::unordered_set<std::string> game_client::connected_ips;
+
+latency_histogram game_client::server_rtt;
+
+game_client::slow_policy game_client::player_policy = game_client::slow_policy::time_out;
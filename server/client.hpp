@@ -4,6 +4,12 @@
 #define ASIO_STANDALONE
 #include <asio.hpp>
 #include "utils/message.hpp"
+#include "utils/shm.hpp"
+#include "timer.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include <array>
+#include <atomic>
 #include <unordered_set>
 #include <optional>
 
@@ -25,6 +31,17 @@ struct identified_msg
  *
  * @details This class is implemented with the asio framework and the protocol
  * in the utils/message.hpp header.
+ *
+ * Sending never blocks: messages go to a bounded outbox, which is written
+ * with non-blocking sends right away, then every FLUSH_INTERVAL on the timer
+ * wheel while the socket is full. A client whose outbox stays full for
+ * SLOW_CONSUMER_TIMEOUT is disconnected. When the outbox overflows, the
+ * message is dropped and the client is handled by its slow_policy.
+ *
+ * A client on the same machine may ask for a shared memory link (see
+ * utils/shm.hpp) right after its id: then every message, both ways, goes
+ * through the link, and the socket only holds the session, its closing is the
+ * disconnection of the client.
  */
 class game_client
 {
@@ -35,23 +52,56 @@ public:
     using queue_type    = msg::queue<identified_msg>;
     using clock_type    = std::chrono::steady_clock;
 
+    /**
+     * What to do with a client whose outbox overflows. A lagging client has
+     * missed messages and is treated as timed out until the game resyncs it.
+     */
+    enum class slow_policy { time_out, disconnect };
+
 public:
+    /* SO_REUSEPORT, which asio has no option for */
+    using reuse_port    = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
     static constexpr std::chrono::duration
         PING_FREQ           = std::chrono::milliseconds(15000),
         PING_TIMEOUT        = std::chrono::milliseconds(300),
-        CONNECTION_TIMEOUT  = std::chrono::milliseconds(400);
+        CONNECTION_TIMEOUT  = std::chrono::milliseconds(400),
+        FLUSH_INTERVAL      = std::chrono::milliseconds(10),
+        SLOW_CONSUMER_TIMEOUT = std::chrono::milliseconds(10000);
+
+    /* Messages, a snapshot must fit */
+    static constexpr std::size_t OUTBOX_CAPACITY = 1024;
 
     static bool                             online_mode;
     static asio::io_context                 context;
+    static timer_wheel                      wheel;
     static protocol::endpoint               server_endpoint;
     static protocol::acceptor               acceptor;
     static std::unordered_set<std::string>  connected_ips;
+    /* Round trip times of the pings of every client */
+    static latency_histogram                server_rtt;
+    static slow_policy                      player_policy;
 
 public:
     id_type uid;
 
+    /**
+     * Round trip times of the pings of this client.
+     */
+    latency_histogram rtt;
+
+    /**
+     * @brief Accept a connection and read its join request. The client does
+     * not listen nor get pinged until it is started.
+     */
     game_client(queue_type &shared_q, unsigned short &game_id, bool &as_player);
 
+    /**
+     * @brief Adopt the socket of a client that joined through another worker,
+     * which already read its join request.
+     */
+    game_client(queue_type &shared_q, int native_socket, id_type id);
+
     game_client(game_client const &) = delete;
 
     game_client(game_client &&other);
@@ -59,10 +109,29 @@ public:
     ~game_client() noexcept;
 
     /**
-     * @return The next uid for a new client.
+     * @brief Open the acceptor on server_endpoint. With reuse_port, other
+     * processes may accept on the same port.
+     */
+    static void listen(bool reuse_port);
+
+    /**
+     * @return The next uid for a new client. The uids of the workers do not
+     * overlap.
      */
     static id_type next_uid() noexcept;
 
+    /**
+     * @brief Take the shared memory links of the local clients of this worker.
+     * Should be run on its own thread, it only returns if the unix socket
+     * cannot be bound.
+     */
+    static void serve_links();
+
+    /**
+     * @brief Start listening to the client and pinging it.
+     */
+    void start();
+
     /**
      * @return The ip string of the client, or empty optional if the ip cannot
      * be retrieved.
@@ -76,31 +145,62 @@ public:
     bool inline operator!=(const game_client &other) const noexcept { return uid != other.uid; }
 
     /**
-     * @brief Attempts to send a message to the client. If it fails, the error
-     * code is logged and the client is disconnected.
+     * @brief Queue a message to the client. If the outbox is full, the message
+     * is dropped and the slow_policy applies.
      *
      * @tparam ObjType The type of the message.
      * @param header The header of the message.
      * @param obj The data of the message.
-     * @return The number of bytes sent.
+     * @return The number of bytes queued.
      */
     template <typename ObjType>
-    std::size_t send(msg::header header, ObjType obj)
+    std::size_t send(msg::header header, ObjType obj) noexcept
     {
-        try
-        {
-            if (socket.is_open())
-                return socket.send(asio::buffer(
-                    msg::buffer_data(header, obj), msg::BUFFER_SIZE));
-        }
-        catch(const std::exception& e)
-        {
-            std::cerr << "Send raised exception: " << e.what() << std::endl;
-            socket.close();
-        }
-        return 0;
+        auto const buf = msg::buffer_data(header, obj);
+        return queue(buf.data(), msg::BUFFER_SIZE, true);
+    }
+
+    /**
+     * @brief Queue all the messages, or none of them if they do not fit, in
+     * which case the slow_policy applies.
+     *
+     * @return The number of bytes queued.
+     */
+    std::size_t send_all(char const *data, std::size_t size) noexcept
+    {
+        return queue(data, size, true);
     }
 
+    /**
+     * @brief Queue as many of the messages as the outbox takes.
+     *
+     * @return The number of bytes queued, which may be 0.
+     */
+    std::size_t send_some(char const *data, std::size_t size) noexcept
+    {
+        return queue(data, size, false);
+    }
+
+    /**
+     * @return The number of messages the outbox can take.
+     */
+    std::size_t outbox_space() const noexcept;
+
+    /**
+     * @return If messages to the client were dropped since it was resynced.
+     */
+    bool inline lagging() const noexcept { return dropped.load(); }
+
+    /**
+     * @brief Clear lagging, once the client was sent the whole state again.
+     */
+    void inline resynced() noexcept { dropped = false; }
+
+    /**
+     * @param p How to handle the client if its outbox overflows.
+     */
+    void inline set_policy(slow_policy p) noexcept { policy = p; }
+
     /**
      * @brief Attempts to receive a message from the client for the given
      * duration.
@@ -114,6 +214,13 @@ public:
     msg::buffer recv(DurationType wait_dur)
     {
         msg::buffer buf;
+        if (local_link)
+        {
+            auto const wait = std::chrono::ceil<std::chrono::milliseconds>(wait_dur);
+            if (auto received = local_link->recv(-1, wait.count()))
+                return *received;
+            return msg::buffer_data(msg::header::timeout, msg::TIMEOUT);
+        }
         std::unique_lock ul(local_m);
         if (local_cv.wait_for(ul, wait_dur,
             [this](){ return socket.available() >= msg::BUFFER_SIZE; }))
@@ -141,36 +248,112 @@ public:
      */
     bool inline is_open() const noexcept { return socket.is_open(); }
 
+    int inline native_handle() noexcept { return socket.native_handle(); }
+
+    /**
+     * @return If the messages go through a shared memory link, which cannot
+     * be handed off to another worker.
+     */
+    bool inline is_local() const noexcept { return local_link.has_value(); }
+
+    /**
+     * @brief Push the messages of the client to another queue from now on,
+     * for a client that joined through another game.
+     */
+    void redirect(queue_type &shared_q) noexcept { q = &shared_q; }
+
 private:
     /**
-     * reference to the shared queue
+     * pointer to the shared queue
      */
-    queue_type &q;
+    std::atomic<queue_type *> q;
 
     std::thread listener;
-    std::thread pinger;
 
     std::mutex local_m;
     std::condition_variable local_cv;
 
-    std::mutex ping_m;
-    std::condition_variable ping_recv;
-
     socket_type socket { context };
 
+    std::optional<shm::link> local_link;
+
+    /* The outbox is a ring of bytes, only whole messages are queued */
+    mutable std::mutex                                  out_m;
+    std::array<char, OUTBOX_CAPACITY * msg::BUFFER_SIZE> outbox;
+    std::size_t                                         out_begin = 0;
+    std::size_t                                         out_size = 0;
+    /* When the socket last stopped taking bytes, 0 if it takes them */
+    clock_type::rep                                     stalled_since = 0;
+    std::atomic<bool>                                   dropped { false };
+    std::atomic<slow_policy>                            policy { slow_policy::disconnect };
+
+    timer_wheel::timer flush_timer { wheel, [this]() {
+        std::scoped_lock lock(out_m);
+        flush();
+    } };
+
+    /* When the unanswered ping was sent, 0 if there is none */
+    std::atomic<clock_type::rep> ping_sent { 0 };
+
+    /**
+     * The ping is sent when ping_timer expires, and the client is disconnected
+     * if pong_timer expires before the reply.
+     */
+    timer_wheel::timer ping_timer { wheel, [this]() { pinging(); } };
+    timer_wheel::timer pong_timer { wheel, [this]() {
+        std::cerr << "Ping not replied by " << uid << " closing connection...\n";
+        close();
+    } };
+
     /**
      * The method for the listening thread to constantly listen for messages
      * until the client disconnects. It also fetches special ping messages to
-     * notify the pinging thread. Ping messages are not added to the queue.
+     * cancel the ping timeout and record the round trip time. Ping messages
+     * are not added to the queue.
      * The method returns when the client disconnects.
      */
     void listening();
 
     /**
-     * The method for the pinging thread to ping the client periodically until
-     * the client disconnects. The method returns when the client disconnects.
+     * The callback of the ping timer, on the thread of the timer wheel. It
+     * queues a ping in the outbox of the client, arms the ping timeout and
+     * rearms itself, until the client disconnects.
      */
     void pinging();
+
+    /**
+     * @brief Put messages in the outbox and try to write them.
+     *
+     * @param whole All the messages or none, with the slow_policy if none.
+     */
+    std::size_t queue(char const *data, std::size_t size, bool whole) noexcept;
+
+    /**
+     * Write what the socket takes without blocking, and arm the flush timer
+     * for the rest. out_m must be held.
+     */
+    void flush() noexcept;
+
+    /**
+     * Receive the next message of the client, from the link or the socket.
+     *
+     * @return false once the client is disconnected.
+     */
+    bool receive(msg::buffer &buf);
+
+    /**
+     * Tell the client which worker takes its link, and wait for the link.
+     *
+     * @return If the link was received in time.
+     */
+    bool attach_link();
+
+    /**
+     * In online mode, reject the client if its ip is already connected.
+     *
+     * @return If the client may stay connected.
+     */
+    bool register_ip();
 };
 
 #endif
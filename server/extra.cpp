@@ -1,6 +1,8 @@
 #include "extra.hpp"
 #include "game.hpp"
+#include "workers.hpp"
 #include <iomanip>
+#include <limits>
 
 std::ostream &time(std::ostream &os)
 {
@@ -18,7 +20,43 @@ void server_debug_terminal()
     {
         std::cin >> s;
         if (s == "count")
-            time(std::cout) << "Running games: " << game::games.size() << std::endl;
+        {
+            std::unique_lock lock(game::games_m);
+            std::size_t const running = game::games.size();
+            lock.unlock();
+            time(std::cout) << "Running games: " << running << std::endl;
+        }
+        else if (s == "latency")
+        {
+            std::cin >> s;
+            if (s == "server")
+            {
+                time(std::cout) << "Latencies of all games:\n";
+                game_client::server_rtt.report(std::cout, "rtt");
+                for (std::size_t d = 0; d < game::server_decisions.size(); ++d)
+                    game::server_decisions[d].report(std::cout, game::DECISION_NAMES[d]);
+            }
+            else if (s == "game")
+            {
+                unsigned short id;
+                std::cin >> id;
+                std::unique_lock lock(game::games_m);
+                auto it = game::games.find(id);
+                bool const found = it != game::games.end();
+                lock.unlock();
+                if (found)
+                {
+                    time(std::cout) << "Latencies of game " << id << ":\n";
+                    it->second.report_latency(std::cout);
+                }
+                else
+                    time(std::cout) << "DEBUG: no game " << id << std::endl;
+            }
+        }
+        else if (s == "metrics")
+            metrics::write(std::cout);
+        else if (s == "timers")
+            time(std::cout) << "Armed timers: " << game_client::wheel.size() << std::endl;
         else if (s == "ip" && game_client::online_mode)
         {
             std::cin >> s;
@@ -46,11 +84,19 @@ void server_debug_terminal()
     exit(0);
 }
 
+/**
+ * The ids of a worker are the ones equal to its index modulo the number of
+ * workers, so that workers::owner finds it back from the id alone.
+ */
 unsigned short game_id()
 {
-    static unsigned short counter = 0x3f40;
+    static unsigned int counter = 0x3f40 - 0x3f40 % workers::count() + workers::index();
 
-    if (++counter == msg::NEW_PLAYER)
-        ++counter;
+    do
+    {
+        counter += workers::count();
+        if (counter > std::numeric_limits<unsigned short>::max())
+            counter = workers::index();
+    } while (counter == msg::NEW_PLAYER);
     return counter;
 }
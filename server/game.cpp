@@ -1,6 +1,8 @@
 #include "game.hpp"
 #include "extra.hpp"
+#include "workers.hpp"
 #include "mahjong/interaction.h"
+#include "mahjong/tile.hpp"
 #include "mahjong/yaku.h"
 #include <algorithm>
 #include <chrono>
@@ -40,24 +42,22 @@ game::game(unsigned short id, std::ostream &server_log,
         auto new_player = std::make_unique<client_type>(messages, g_id, as_player);
         if (!new_player->is_open())
             continue;
-        if (as_player)
+        if (as_player && g_id == msg::NEW_PLAYER)
         {
-            if (g_id == msg::NEW_PLAYER)
-            {
-                time(server_log) << "New connection from " <<
-                    new_player->ip().value_or("unknown ip") << " assigned " <<
-                    new_player->uid << std::endl;
-                players.emplace_back(std::move(new_player));
-            }
-            else if (games.find(g_id) != games.end())
-                games.at(g_id).reconnect(std::move(new_player));
-            else
-                new_player->reject();
+            time(server_log) << "New connection from " <<
+                new_player->ip().value_or("unknown ip") << " assigned " <<
+                new_player->uid << std::endl;
+            new_player->set_policy(client_type::player_policy);
+            new_player->start();
+            players.emplace_back(std::move(new_player));
         }
-        else
+        else if (!as_player && g_id == game_id)
         {
+            new_player->start();
             accept_spectator(std::move(new_player));
         }
+        else
+            route(std::move(new_player), g_id, as_player);
 
         for (auto &player : players)
             player->send(msg::header::queue_size, players.size());
@@ -78,34 +78,155 @@ game::game(unsigned short id, std::ostream &server_log,
 }
 
 /**
- * Accept Spectator by locking the spectator list first before
- * emplacing the new client as a spectator.
+ * Route a client: the socket is handed off if the game belongs to another
+ * worker, as the client has not been started yet. A local client is not, its
+ * link was given to this worker.
+ */
+void game::route(client_ptr &&client, game_id_type id, bool as_player)
+{
+    if (workers::owner(id) != workers::index())
+    {
+        if (client->is_local())
+            return client->reject();
+        return workers::hand_off(std::move(client), id, as_player);
+    }
+
+    std::unique_lock lock(games_m);
+    auto it = games.find(id);
+    if (it == games.end())
+        return client->reject();
+    lock.unlock();
+
+    client->start();
+    if (as_player)
+        it->second.reconnect(std::move(client));
+    else
+        it->second.accept_spectator(std::move(client));
+}
+
+/**
+ * Accept Spectator by queueing it for the game thread, which hands it to the
+ * relay after its snapshot.
  */
 void game::accept_spectator(client_ptr &&client)
 {
-    std::scoped_lock lock(spectator_mutex);
-    spectators.emplace_back(std::move(client));
+    {
+        std::scoped_lock lock(timeout_m);
+        joins.push_back({std::move(client), false});
+    }
+    timeout_cv.notify_all();
 }
 
 /**
- * Perform a reconnection by checking if the original socket is closed.
- * If so, it will reconnect the player. Otherwise, it does nothing.
+ * Queue a reconnection for the game thread, which only touches the players.
  */
 void game::reconnect(client_ptr &&client)
 {
-    client_type::id_type uid = client->uid;
-    auto it = std::find_if(players.begin(), players.end(),
-        [uid](client_ptr const &p){
-            return p->uid == uid && !p->is_open(); });
+    {
+        std::scoped_lock lock(timeout_m);
+        joins.push_back({std::move(client), true});
+    }
+    timeout_cv.notify_all();
+}
 
+/**
+ * On the game thread, between two messages. A reconnection is done if the
+ * original socket of the player is closed, otherwise it is rejected. Both
+ * players and spectators are sent a snapshot before anything else, so the
+ * messages that follow it continue it exactly.
+ */
+void game::handle_joins()
+{
+    std::unique_lock lock(timeout_m);
+    auto pending = std::move(joins);
+    joins.clear();
+    lock.unlock();
 
-    if (it != players.end())
+    for (auto &join : pending)
     {
-        *it = std::move(client);
+        if (!join.as_player)
+        {
+            snapshot const s = take_snapshot(NUM_PLAYERS);
+            join.client->send_all(s.data(), s.size());
+            relay.subscribe(std::move(join.client), events, SPECTATOR_DELAY);
+            continue;
+        }
+
+        client_type::id_type uid = join.client->uid;
+        auto it = std::find_if(players.begin(), players.end(),
+            [uid](client_ptr const &p){
+                return p->uid == uid && !p->is_open(); });
+
+        if (it == players.end())
+        {
+            join.client->reject();
+            continue;
+        }
+
+        join.client->redirect(messages);
+        join.client->set_policy(client_type::player_policy);
+        *it = std::move(join.client);
+        snapshot const s = take_snapshot(it - players.begin());
+        (*it)->send_all(s.data(), s.size());
         time(server_log) << "Player " << uid << " reconnected." << std::endl;
     }
 }
 
+/**
+ * A lagging player missed messages, so once its outbox has room it is sent
+ * the whole state again, after which the messages follow on.
+ */
+void game::resync_players()
+{
+    for (int p = 0; p < NUM_PLAYERS; ++p)
+    {
+        if (!players[p]->lagging() || players[p]->outbox_space() < snapshot::MAX_MESSAGES)
+            continue;
+        players[p]->resynced();
+        snapshot const s = take_snapshot(p);
+        players[p]->send_all(s.data(), s.size());
+        metrics::add(metrics::resyncs);
+        time(server_log) << "Player " << players[p]->uid << " resynced." << std::endl;
+    }
+}
+
+snapshot game::take_snapshot(int viewer) const
+{
+    snapshot s;
+    s.push(msg::header::snapshot, msg::START_STREAM);
+    s.push(msg::header::new_round, (prevailing_wind<<2) + dealer);
+    if (viewer < NUM_PLAYERS)
+        s.push(msg::header::your_position, viewer);
+    s.push(msg::header::current_player, cur_player);
+    for (auto const &indicator : dora_tiles)
+        s.push(msg::header::dora_indicator, indicator);
+
+    for (int p = 0; p < NUM_PLAYERS; ++p)
+    {
+        s.push(msg::header::seat, p);
+        s.push(msg::header::seat_score, scores[p] / 100);
+
+        s.push(msg::header::closed_hand, msg::START_STREAM);
+        for (auto *it = hands[p].tiles; it < hands[p].tiles + hands[p].size; ++it)
+            s.push(msg::header::tile,
+                p == viewer || !MJ_IS_OPAQUE(*it) ? *it : MJ_INVALID_TILE);
+        s.push(msg::header::closed_hand, msg::END_STREAM);
+
+        for (auto *it = melds[p].melds; it < melds[p].melds + melds[p].size; ++it)
+        {
+            s.push(msg::header::meld_low, *it & 0xffff);
+            s.push(msg::header::meld_high, *it >> 16);
+        }
+        for (auto const &tile : discards[p])
+            s.push(msg::header::discarded, tile);
+        if (flags[p] & ANY_RIICHI_FLAG)
+            s.push(msg::header::this_player_riichi, p);
+    }
+
+    s.push(msg::header::snapshot, msg::END_STREAM);
+    return s;
+}
+
 /******************************************************************************/
 
 /**
@@ -282,17 +403,13 @@ game::state_type game::call_tsumo()
             dora_tiles.push_back(wall.draw_dora());
     }
 
-    for (auto &indicator : dora_tiles)
-    {
-        yakus[MJ_YAKU_DORA] += std::count_if(hands[cur_player].tiles,
-        hands[cur_player].tiles+hands[cur_player].size,
-        [indicator](const card_type &tile){
-            return calc_dora(indicator) == MJ_ID_128(tile);
-        });
-    }
+    yakus[MJ_YAKU_DORA] = count_dora(cur_player);
 
+    auto const score_start = clock_type::now();
     int score = mj_score(&fu, &fan, yakus, &hands[cur_player],
         &melds[cur_player], cur_tile, MJ_TRUE, prevailing_wind, seat_wind);
+    metrics::add(metrics::score_calls);
+    metrics::add_time(metrics::score_ns, clock_type::now() - score_start);
 
     if (score)
     {
@@ -345,7 +462,11 @@ void game::play()
 {
     while (true)
     {
-        switch (cur_state)
+        handle_joins();
+        resync_players();
+        auto const state = cur_state;
+        auto const state_start = clock_type::now();
+        switch (state)
         {
         case state_type::game_over:
             return;
@@ -372,6 +493,8 @@ void game::play()
         case state_type::chombo:
             chombo_penalty(); break;
         }
+        metrics::add_time(static_cast<metrics::counter>(
+            metrics::state_ns + static_cast<int>(state)), clock_type::now() - state_start);
     }
 }
 
@@ -443,12 +566,12 @@ void game::start_round()
 game::state_type game::self_call()
 {
     msg::buffer buffer, aux;
-    auto timeout_time = clock_type::now() + SELF_CALL_TIMEOUT;
-
+    turn_timer.arm(SELF_CALL_TIMEOUT);
+    await_decision(cur_player, decision::self_call);
 
     while(true) /* We allow retrys until timeout */
     {
-        buffer = fetch_cur(timeout_time);
+        buffer = fetch_cur();
         msg::header ty = msg::type(buffer);
         switch (ty)
         {
@@ -456,7 +579,7 @@ game::state_type game::self_call()
             std::cout << "self call timeout " << cur_player << std::endl;
             return state_type::tsumogiri;
         case msg::header::call_kong:
-            aux = fetch_cur(timeout_time);
+            aux = fetch_cur();
             if (msg::type(aux)==msg::header::call_with_tile
                 && self_call_kong(msg::data<card_type>(aux)))
                 return state_type::after_kong;
@@ -505,8 +628,9 @@ game::state_type game::self_call()
 
 game::state_type game::discard()
 {
-    auto timeout_time = clock_type::now() + DISCARD_TIMEOUT;
-    msg::buffer buffer = fetch_cur(timeout_time);
+    turn_timer.arm(DISCARD_TIMEOUT);
+    await_decision(cur_player, decision::discard);
+    msg::buffer buffer = fetch_cur();
     auto discarded = msg::data<card_type>(buffer);
 
     if (game_flags & KONG_FLAG && dora_tiles.size() >= MAX_DORAS)
@@ -565,7 +689,7 @@ game::state_type game::opponent_call()
     // if player is in furiten, continue because cannot ron
         if (std::find_if(discards[p].begin(), discards[p].end(),
             [&](const card_type &tile) {
-                return MJ_ID_128(tile) == MJ_ID_128(cur_tile);
+                return mj::tile{tile}.kind() == mj::tile{cur_tile}.kind();
             }) != discards[p].end())
                 continue;
 
@@ -583,44 +707,55 @@ game::state_type game::opponent_call()
         yakus_if_ron[p][MJ_YAKU_CHANKAN] = (game_flags & KONG_FLAG) ? 1 : 0;
         yakus_if_ron[p][MJ_YAKU_HOUTEI] = wall.size() ? 0 : 1;
 
+        auto const score_start = clock_type::now();
         mj_score(&fu_if_ron[p], &fan_if_ron[p], yakus_if_ron[p].data(), &tmp_hand,
             &melds[p], cur_tile, MJ_FALSE, prevailing_wind, seat_wind);
+        metrics::add(metrics::score_calls);
+        metrics::add_time(metrics::score_ns, clock_type::now() - score_start);
     }
 
 
     std::array<mj_bool, 10> priority {};
-    std::array<std::vector<card_type,
-        optim<NUM_PLAYERS>::allocator<card_type>>, NUM_PLAYERS - 1> call_tiles;
+    std::array<small_vector<card_type, NUM_PLAYERS>, NUM_PLAYERS - 1> call_tiles;
+
+    // the call masks of each hand are kept up to date by mj_add_tile and
+    // mj_discard_tile, so checking the calls is only a few bit tests
+    mj_mask const tile_bit = MJ_KIND_BIT(cur_tile);
 
     if ( !(flags[order[0]] & ANY_RIICHI_FLAG) )
     {
-        priority[0] = mj_chow_available(hands[order[0]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
-        priority[3] = mj_pong_available(hands[order[0]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
-        priority[6] = mj_kong_available(hands[order[0]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
+        priority[0] = (hands[order[0]].chow_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
+        priority[3] = (hands[order[0]].pong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
+        priority[6] = (hands[order[0]].kong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
     }
     if ( !(flags[order[1]] & ANY_RIICHI_FLAG) )
     {
-        priority[5] = mj_kong_available(hands[order[1]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
-        priority[2] = mj_pong_available(hands[order[1]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
+        priority[5] = (hands[order[1]].kong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
+        priority[2] = (hands[order[1]].pong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
     }
     if ( !(flags[order[2]] & ANY_RIICHI_FLAG) )
     {
-        priority[1] = mj_pong_available(hands[order[2]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
-        priority[4] = mj_kong_available(hands[order[2]], cur_tile, nullptr) ?
-            MJ_MAYBE : MJ_FALSE;
+        priority[1] = (hands[order[2]].pong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
+        priority[4] = (hands[order[2]].kong_mask & tile_bit) ? MJ_MAYBE : MJ_FALSE;
     }
 
     priority[7] = fan_if_ron[order[2]] > 0 ? MJ_MAYBE : MJ_FALSE;
     priority[8] = fan_if_ron[order[1]] > 0 ? MJ_MAYBE : MJ_FALSE;
     priority[9] = fan_if_ron[order[0]] > 0 ? MJ_MAYBE : MJ_FALSE;
 
-    auto timeout_time = clock_type::now() + OPPONENT_CALL_TIMEOUT;
+    // a lagging player does not know of the discard, so it cannot call
+    for (int i = 0; i < NUM_PLAYERS - 1; ++i)
+    {
+        if (!players[order[i]]->lagging())
+            continue;
+        priority[9-i] = priority[6-i] = priority[3-i] = MJ_FALSE;
+        if (i == 0)
+            priority[0] = MJ_FALSE;
+    }
+
+    turn_timer.arm(OPPONENT_CALL_TIMEOUT);
+    for (auto const &p : order)
+        await_decision(p, decision::opponent_call);
     int max_priority = 9;
     while (true)
     {
@@ -635,16 +770,16 @@ game::state_type game::opponent_call()
             (max_priority == 0 && call_tiles[0].size() >= 2)
         )) break;
 
-        std::unique_lock ul(timeout_m);
-        if (!timeout_cv.wait_until(ul, timeout_time, [this]() { return !messages.empty(); }))
+        auto const call = next_message();
+        if (!call)
             break;
 
-        auto call = messages.pop_front();
-        int player = player_id_map[call.id];
+        int player = player_id_map[call->id];
         if (player == cur_player)
             continue;
+        record_decision(player);
         int player_p = std::find(order.begin(), order.end(), player) - order.begin();
-        switch(msg::type(call.data))
+        switch(msg::type(call->data))
         {
         case msg::header::call_ron:
             if (priority[9-player_p] == MJ_MAYBE)
@@ -673,7 +808,7 @@ game::state_type game::opponent_call()
             break;
         case msg::header::call_with_tile:
             if (call_tiles[player_p].size() < 3)
-                call_tiles[player_p].push_back(msg::data<card_type>(call.data));
+                call_tiles[player_p].push_back(msg::data<card_type>(call->data));
             break;
         default:
             break;
@@ -696,32 +831,7 @@ game::state_type game::opponent_call()
             for (std::size_t i = 0; i < doras; ++i)
                 dora_tiles.push_back(wall.draw_dora());
         }
-        for (auto &indicator : dora_tiles)
-        {
-            yakus_if_ron[ron_player][MJ_YAKU_DORA] += std::count_if(
-                hands[ron_player].tiles, hands[ron_player].tiles+hands[ron_player].size,
-            [indicator](const card_type &tile){
-                return calc_dora(indicator) == MJ_ID_128(tile);
-            });
-            for (auto *i = melds[ron_player].melds;
-                i < melds[ron_player].melds+melds[ron_player].size; ++i)
-            {
-                if (MJ_IS_KONG(*i))
-                {
-                    yakus_if_ron[ron_player][MJ_YAKU_DORA] +=
-                        calc_dora(indicator) == MJ_ID_128(MJ_FIRST(*i)) ? 4 : 0;
-                }
-                else
-                {
-                    yakus_if_ron[ron_player][MJ_YAKU_DORA] +=
-                        calc_dora(indicator) == MJ_ID_128(MJ_FIRST(*i)) ? 1 : 0;
-                    yakus_if_ron[ron_player][MJ_YAKU_DORA] +=
-                        calc_dora(indicator) == MJ_ID_128(MJ_SECOND(*i)) ? 1 : 0;
-                    yakus_if_ron[ron_player][MJ_YAKU_DORA] +=
-                        calc_dora(indicator) == MJ_ID_128(MJ_THIRD(*i)) ? 1 : 0;
-                }
-            }
-        }
+        yakus_if_ron[ron_player][MJ_YAKU_DORA] = count_dora(ron_player, cur_tile);
 
         score_type b_score = mj_basic_score(fu_if_ron[ron_player],
             fan_if_ron[ron_player]+yakus_if_ron[ron_player][MJ_YAKU_DORA]);
@@ -814,10 +924,10 @@ game::state_type game::opponent_call()
             call_tiles[0][0], call_tiles[0][1], cur_tile
         };
         std::sort(chow_tiles.begin(), chow_tiles.end());
-        if (MJ_NUMBER(chow_tiles[2]) - MJ_NUMBER(chow_tiles[1]) != 1 ||
-            MJ_NUMBER(chow_tiles[1]) - MJ_NUMBER(chow_tiles[0]) != 1 ||
-            MJ_SUIT(chow_tiles[0]) != MJ_SUIT(chow_tiles[1]) ||
-            MJ_SUIT(chow_tiles[0]) != MJ_SUIT(chow_tiles[2]))
+        mj::kind const low = mj::tile{chow_tiles[0]}.kind();
+        if (mj::tile{chow_tiles[0]}.honor() || low.number() > 6 ||
+            mj::tile{chow_tiles[1]}.kind().index() != low.index() + 1 ||
+            mj::tile{chow_tiles[2]}.kind().index() != low.index() + 2)
         {
             players[cur_player]->send(msg::header::reject, msg::REJECT);
             goto NO_CALL;
@@ -844,13 +954,20 @@ game::state_type game::opponent_call()
     // all players pass or timeout
 NO_CALL:
     cur_player = order[0];
-    std::this_thread::sleep_for(
-        wall.tiger() / static_cast<float>(0xffff) * END_TURN_DELAY);
+    turn_timer.arm(wall.tiger() / static_cast<float>(0xffff) * END_TURN_DELAY);
+    wait_turn_timer();
     return state_type::draw;
 }
 
+/**
+ * Waits NEW_ROUND_DELAY for the clients to show the results of the round, then
+ * moves the dealer (and the prevailing wind) forward.
+ */
 void game::next()
 {
+    turn_timer.arm(NEW_ROUND_DELAY);
+    wait_turn_timer();
+
     bonus_score = 0;
     deposit = 0;
     if (++dealer == NUM_PLAYERS)
@@ -861,8 +978,15 @@ void game::next()
     cur_state = state_type::start_round;
 }
 
+/**
+ * Waits NEW_ROUND_DELAY for the clients to show the results of the round, then
+ * the dealer keeps their seat.
+ */
 void game::renchan()
 {
+    turn_timer.arm(NEW_ROUND_DELAY);
+    wait_turn_timer();
+
     bonus_score += MJ_BONUS_SCORE;
     cur_state = state_type::start_round;
 }
@@ -877,21 +1001,22 @@ void game::exhaustive_draw()
     int players_tenpai = 0;
     int players_responded = 0b0000;
 
-    auto timeout_time = clock_type::now() + TENPAI_TIMEOUT;
+    for (int p = 0; p < NUM_PLAYERS; ++p)
+        if (players[p]->lagging())
+            players_responded |= 1 << p;
 
+    turn_timer.arm(TENPAI_TIMEOUT);
 
     while (players_responded != 0b1111)
     {
-        std::unique_lock ul(timeout_m);
-        if (!timeout_cv.wait_until(ul, timeout_time, [this]() {
-                return !messages.empty(); }))
+        auto const call = next_message();
+        if (!call)
             break;
 
-        auto call = messages.pop_front();
-        if (msg::type(call.data) == msg::header::call_tenpai)
+        if (msg::type(call->data) == msg::header::call_tenpai)
         {
-            int player = player_id_map[call.id];
-            switch(msg::data<unsigned short>(call.data))
+            int player = player_id_map[call->id];
+            switch(msg::data<unsigned short>(call->data))
             {
             case msg::TENPAI:
                 tenpai[player] = MJ_TRUE;
@@ -1005,17 +1130,104 @@ void game::chombo_penalty()
 
 mj_id game::calc_dora(game::card_type tile)
 {
-    switch(MJ_SUIT(tile))
+    return mj::tile{tile}.dora().id_128();
+}
+
+/**
+ * The dora of the closed hand and the melds of the player (and the ron tile,
+ * which is not in the hand yet), for every indicator (including the ura dora
+ * if they were drawn).
+ */
+int game::count_dora(int player, card_type ron) const
+{
+    mj::hand_view const hand {hands[player]};
+    mj::meld_view const meld {melds[player]};
+    int count = 0;
+    for (auto const &indicator : dora_tiles)
+    {
+        mj::kind const dora = mj::tile{indicator}.dora();
+        count += hand.count(dora) + meld.count(dora) + (mj::tile{ron}.kind() == dora);
+    }
+    return count;
+}
+
+std::optional<game::message_type> game::next_message()
+{
+    std::unique_lock ul(timeout_m);
+    while (true)
+    {
+        timeout_cv.wait(ul, [this]() {
+            return !messages.empty() || turn_timer.expired() || !joins.empty(); });
+        if (joins.empty())
+            break;
+        ul.unlock();
+        handle_joins();
+        ul.lock();
+    }
+    if (messages.empty())
+        return std::nullopt;
+    return messages.pop_front();
+}
+
+msg::buffer game::fetch_cur()
+{
+    // a lagging player is not waited for, it does not know it has to play
+    if (players[cur_player]->lagging())
+        return msg::buffer_data(msg::header::timeout, msg::TIMEOUT);
+
+    while (auto msg = next_message())
     {
-    case MJ_WIND:
-        return MJ_128_TILE(MJ_WIND, (MJ_ID_128(tile) + 1) % 4);
-    case MJ_DRAGON:
-        return MJ_128_TILE(MJ_DRAGON, (MJ_ID_128(tile) + 1) % 3);
-    default:
-        return MJ_128_TILE(MJ_SUIT(tile), (MJ_ID_128(tile) + 1) % 9);
+        if (msg->id == players[cur_player]->uid)
+        {
+            record_decision(cur_player);
+            return msg->data;
+        }
+    }
+    return msg::buffer_data(msg::header::timeout, msg::TIMEOUT);
+}
+
+void game::wait_turn_timer()
+{
+    std::unique_lock ul(timeout_m);
+    while (true)
+    {
+        timeout_cv.wait(ul, [this]() { return turn_timer.expired() || !joins.empty(); });
+        if (joins.empty())
+            break;
+        ul.unlock();
+        handle_joins();
+        ul.lock();
     }
 }
 
+/**
+ * The latency of the decision is recorded when the first message of the
+ * player arrives. A decision that is never made is not recorded.
+ */
+void game::await_decision(int player, decision d)
+{
+    awaited[player] = d;
+    awaited_since[player] = clock_type::now();
+}
+
+void game::record_decision(int player)
+{
+    if (!awaited[player])
+        return;
+    auto const latency = clock_type::now() - awaited_since[player];
+    decisions[static_cast<int>(*awaited[player])].record(latency);
+    server_decisions[static_cast<int>(*awaited[player])].record(latency);
+    awaited[player].reset();
+}
+
+void game::report_latency(std::ostream &os) const
+{
+    for (auto const &player : players)
+        player->rtt.report(os, ("rtt " + std::to_string(player->uid)).c_str());
+    for (std::size_t d = 0; d < decisions.size(); ++d)
+        decisions[d].report(os, DECISION_NAMES[d]);
+}
+
 void game::log_cur(char const *msg)
 {
     game_log << cur_player << " " << msg << " " << MJ_NUMBER1(cur_tile) <<
@@ -1023,9 +1235,14 @@ void game::log_cur(char const *msg)
 }
 
 std::unordered_map<unsigned short, game> game::games;
+std::mutex game::games_m;
 
 std::array<char, 5> game::suit {'m', 'p', 's', 'w', 'd'};
 
 std::array<char, 4> game::directions {'E', 'S', 'W', 'N'};
 
 std::array<char, 4> game::delim {' ', '_', '-', '^'};
+
+game::decisions_type game::server_decisions;
+
+spectator_relay game::relay;
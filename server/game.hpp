@@ -3,6 +3,8 @@
 
 #include "deck.hpp"
 #include "client.hpp"
+#include "relay.hpp"
+#include "snapshot.hpp"
 #include "utils/optim.hpp"
 
 #include <fstream>
@@ -11,6 +13,7 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <optional>
 
 /**
  * @brief Set the server to online mode, meaning it will verify there is at most
@@ -51,20 +54,17 @@ public:
     using protocol          = asio::ip::tcp;
     using client_type       = game_client;
     using client_ptr        = std::unique_ptr<client_type>;
-    using players_allocator = optim<NUM_PLAYERS>::allocator<client_ptr>;
-    using players_type      = std::vector<client_ptr, players_allocator>;
-    using spectators_type   = std::list<client_ptr>;
+    using players_type      = small_vector<client_ptr, NUM_PLAYERS>;
     using message_type      = identified_msg;
     using flag_type         = unsigned short;
     using deck_type         = deck;
     using card_type         = typename deck_type::card_type;
     using score_type        = int;
-    using discards_allocator= optim<MAX_DISCARD_PER_PLAYER>::allocator<card_type>;
-    using discards_type     = std::vector<card_type, discards_allocator>;
+    using discards_type     = small_vector<card_type, MAX_DISCARD_PER_PLAYER>;
     using state_type        = turn_state;
     using clock_type        = typename client_type::clock_type;
     using game_id_type      = unsigned short;
-    using doras_allocator   = optim<MAX_DORAS*2>::allocator<card_type>;
+    using doras_type        = small_vector<card_type, MAX_DORAS*2>;
 
 public:
     static constexpr std::chrono::duration
@@ -74,7 +74,8 @@ public:
         OPPONENT_CALL_TIMEOUT   = std::chrono::milliseconds(60000),
         TENPAI_TIMEOUT          = std::chrono::milliseconds(60000),
         END_TURN_DELAY          = std::chrono::milliseconds(2000),
-        NEW_ROUND_DELAY         = std::chrono::milliseconds(12600);
+        NEW_ROUND_DELAY         = std::chrono::milliseconds(12600),
+        SPECTATOR_DELAY         = std::chrono::milliseconds(0);
 
     static constexpr flag_type
         RIICHI_FLAG             = 0x0001,
@@ -82,6 +83,15 @@ public:
         ANY_RIICHI_FLAG         = RIICHI_FLAG | DOUBLE_RIICHI_FLAG,
         IPPATSU_FLAG            = 0x0004;
 
+    /**
+     * The decisions whose latency is recorded: from when the server waits for
+     * a player to their first message.
+     */
+    enum class decision { self_call, discard, opponent_call, count };
+    using decisions_type = std::array<latency_histogram, static_cast<int>(decision::count)>;
+    static constexpr std::array<char const *, static_cast<int>(decision::count)>
+        DECISION_NAMES = { "self call", "discard", "opponent call" };
+
     static constexpr flag_type
         HEADS_UP_FLAG           = 0x0001,
         FIRST_TURN_FLAG         = 0x0002,
@@ -89,7 +99,10 @@ public:
         OTHER_KONG_FLAG         = 0x0008,
         KONG_FLAG               = 0x000c;
 
+    /* The games of this process. A game is inserted once its players have
+     * joined, and never removed, so a game found stays valid after unlocking */
     static std::unordered_map<game_id_type, game> games;
+    static std::mutex games_m;
 
     static std::array<char, 5> suit;
 
@@ -97,28 +110,44 @@ public:
 
     static std::array<char, 4> delim;
 
+    /* Decision latencies of every game */
+    static decisions_type server_decisions;
+
+    /* Streams the broadcasts of every game to their spectators */
+    static spectator_relay relay;
+
 public:
     game(game_id_type id, std::ostream &server_log, std::string const &game_log_file, bool heads_up);
 
     ~game() = default;
 
+    /**
+     * @brief Send a reconnecting player or a spectator to its game, which may
+     * run in another worker. The client is rejected if there is no such game.
+     */
+    static void route(client_ptr &&client, game_id_type id, bool as_player);
+
     /**
      * Perform the ping. If ping cannot be recieved, the client will be disconnected.
      */
     void ping();
 
     /**
-     * Add a spectator to the game.
+     * Add a spectator to the game. The game thread sends it a snapshot, then
+     * the relay streams it the broadcasts that follow.
      */
     void accept_spectator(client_ptr &&socket);
 
     /**
-     * Perform a reconnection.
+     * Perform a reconnection. The game thread swaps in the socket and sends
+     * the player a snapshot.
      */
     void reconnect(client_ptr &&socket);
 
     /**
-     * 1 way communication from the game to all players and spectators.
+     * 1 way communication from the game to all players and spectators. The
+     * spectators are not sent to here: the message is appended to the
+     * broadcast log, which the relay streams to them.
      */
     template <typename ObjType>
     void broadcast(msg::header header, ObjType obj, bool exclusive=false)
@@ -127,8 +156,7 @@ public:
             if (!exclusive || player != players[cur_player])
                 player->send(header, obj);
 
-        for (auto &spectator : spectators)
-            spectator->send(header, obj);
+        events->append(msg::buffer_data(header, obj));
     }
 
     /**
@@ -145,15 +173,46 @@ public:
      */
     static mj_id calc_dora(card_type indicator);
 
+    /**
+     * @brief Print the round trip times of the players and the decision
+     * latencies of the game.
+     */
+    void report_latency(std::ostream &os) const;
+
+    /**
+     * @brief The state of the game as a viewer sees it: the opaque tiles of
+     * the hands of the others are hidden. Must be called on the game thread.
+     *
+     * @param viewer The seat of the viewer, or NUM_PLAYERS for a spectator.
+     */
+    snapshot take_snapshot(int viewer) const;
+
+    /**
+     * @return The number of messages waiting to be handled.
+     */
+    std::size_t queue_depth() const noexcept { return messages.size(); }
+
 private:
     /* Message handling */
     players_type                            players;
-    spectators_type                         spectators;
+    std::shared_ptr<broadcast_log>          events { std::make_shared<broadcast_log>() };
     std::condition_variable                 timeout_cv;
     std::mutex                              timeout_m;
     msg::queue<message_type>                messages { timeout_cv };
+    timer_wheel::timer                      turn_timer { client_type::wheel, [this]() {
+        std::scoped_lock lock(timeout_m);
+        timeout_cv.notify_all();
+    } };
     std::map<client_type::id_type, int>     player_id_map;
 
+    /* Clients joining mid game, guarded by timeout_m */
+    struct join_request
+    {
+        client_ptr  client;
+        bool        as_player;
+    };
+    std::vector<join_request>               joins;
+
     /* Player state */
     std::array<mj_hand, NUM_PLAYERS>        hands   {};
     std::array<mj_meld, NUM_PLAYERS>        melds   {};
@@ -168,7 +227,7 @@ private:
 
     /* Round level states */
     deck_type                               wall;
-    std::vector<card_type, doras_allocator> dora_tiles;
+    doras_type                              dora_tiles;
     int                                     prevailing_wind { MJ_EAST };
     int                                     dealer          { 0 };
     flag_type                               game_flags;
@@ -181,9 +240,13 @@ private:
     score_type      bonus_score {};
     unsigned short  round       {};
 
+    /* Decision latencies */
+    decisions_type                                      decisions;
+    std::array<std::optional<decision>, NUM_PLAYERS>    awaited         {};
+    std::array<clock_type::time_point, NUM_PLAYERS>     awaited_since   {};
+
     /* Aux Objects */
     std::thread main_thread;
-    std::mutex  spectator_mutex;
     std::mutex  rng_mutex;
 
 private:
@@ -210,36 +273,39 @@ private:
     /* Helpers */
     void draw();
     void new_dora();
+    int count_dora(int player, card_type ron = MJ_INVALID_TILE) const;
     void payment(int player, score_type score);
     bool self_call_kong(card_type with);
     state_type call_tsumo();
     void log_cur(char const *msg);
+    void handle_joins();
+    void resync_players();
+    void await_decision(int player, decision d);
+    void record_decision(int player);
 
 private:
+    /* Waiting on the turn timer, which must be armed first */
+
+    /**
+     * @brief Waits for the next message from anyone.
+     *
+     * @return The next message, or an empty optional if the turn timer
+     * expired first.
+     */
+    std::optional<message_type> next_message();
+
     /**
      * @brief Tries to fetch the first message that is sent by the current player.
      *
-     * @tparam TimepointType chrono is stupid.
-     * @param until The time to wait until before timing out.
      * @return The first message that is sent by the current player, or timeout
-     * TIMEOUT if timed out.
+     * TIMEOUT if the turn timer expired first.
      */
-    template <typename TimepointType>
-    msg::buffer fetch_cur(TimepointType until)
-    {
-        while (true)
-        {
-            std::unique_lock ul(timeout_m);
-            std::cout << messages.empty();
-            if (!timeout_cv.wait_until(ul, until, [this]() { return !messages.empty(); }))
-                return msg::buffer_data(msg::header::timeout, msg::TIMEOUT);
-
-            auto msg = messages.pop_front();
-
-            if (msg.id == players[cur_player]->uid)
-                return msg.data;
-        }
-    }
+    msg::buffer fetch_cur();
+
+    /**
+     * @brief Waits for the turn timer to expire. Messages are left in the queue.
+     */
+    void wait_turn_timer();
 };
 
 #endif
@@ -0,0 +1,162 @@
+#ifndef MJ_SERVER_HISTOGRAM_HPP
+#define MJ_SERVER_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+/**
+ * @brief A lock free histogram of latencies in microseconds, with the buckets
+ * of an HDR histogram: each power of two is split in SUB_BUCKETS/2 buckets,
+ * so a value is known within 1/(SUB_BUCKETS/2) of itself from 0 to about an
+ * hour.
+ *
+ * @details Recording is a few relaxed atomic increments, so any thread can
+ * record while another reads. A read during a record may see the count
+ * before the bucket, which only moves a percentile by one sample.
+ */
+class latency_histogram
+{
+public:
+    using value_type    = std::uint32_t;
+    using count_type    = std::uint64_t;
+    using duration_type = std::chrono::microseconds;
+
+    static constexpr int SUB_BUCKET_BITS = 6;
+    static constexpr int SUB_BUCKETS     = 1 << SUB_BUCKET_BITS;
+    static constexpr int HALF_BUCKETS    = SUB_BUCKETS / 2;
+    static constexpr int BUCKETS =
+        (32 - SUB_BUCKET_BITS + 1) * HALF_BUCKETS + HALF_BUCKETS;
+
+public:
+    latency_histogram() = default;
+    latency_histogram(latency_histogram const &) = delete;
+    latency_histogram &operator=(latency_histogram const &) = delete;
+
+    /**
+     * @brief Record a latency, clamped to about an hour.
+     */
+    template <typename DurationType>
+    void record(DurationType latency) noexcept
+    {
+        auto const us = std::chrono::duration_cast<duration_type>(latency).count();
+        auto const value = static_cast<value_type>(
+            std::clamp<decltype(us)>(us, 0, UINT32_MAX));
+
+        counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+
+        value_type prev = largest.load(std::memory_order_relaxed);
+        while (prev < value && !largest.compare_exchange_weak(prev, value,
+            std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Add the samples of another histogram, which may still be
+     * recording.
+     */
+    void add(latency_histogram const &other) noexcept
+    {
+        for (int i = 0; i < BUCKETS; ++i)
+            counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+        total.fetch_add(other.count(), std::memory_order_relaxed);
+        sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        value_type prev = largest.load(std::memory_order_relaxed);
+        while (prev < other.max() && !largest.compare_exchange_weak(prev, other.max(),
+            std::memory_order_relaxed));
+    }
+
+    count_type count() const noexcept { return total.load(std::memory_order_relaxed); }
+    value_type max() const noexcept { return largest.load(std::memory_order_relaxed); }
+
+    /**
+     * @return The mean in microseconds, or 0 if nothing was recorded.
+     */
+    double mean() const noexcept
+    {
+        count_type const n = count();
+        return n ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    /**
+     * @brief The value below which the given percentage of the samples are.
+     *
+     * @param percent From 0 to 100.
+     * @return The highest value of the bucket of the percentile in
+     * microseconds, or 0 if nothing was recorded.
+     */
+    value_type percentile(double percent) const noexcept
+    {
+        count_type const n = count();
+        if (n == 0)
+            return 0;
+        auto rank = static_cast<count_type>(percent / 100.0 * n + 0.5);
+        rank = std::clamp<count_type>(rank, 1, n);
+
+        count_type seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(highest_equivalent(i), max());
+        }
+        return max();
+    }
+
+    /**
+     * @brief Print the count, mean, usual percentiles and max in milliseconds
+     * on one line, after the name.
+     */
+    void report(std::ostream &os, char const *name) const
+    {
+        auto const ms = [](double us) { return us / 1000.0; };
+        auto const flags = os.flags();
+        auto const precision = os.precision();
+        os << std::left << std::setw(16) << name << std::right << std::fixed
+            << std::setprecision(1)
+            << " n="     << count()
+            << " mean="  << ms(mean())
+            << " p50="   << ms(percentile(50))
+            << " p90="   << ms(percentile(90))
+            << " p99="   << ms(percentile(99))
+            << " p99.9=" << ms(percentile(99.9))
+            << " max="   << ms(max()) << " ms" << std::endl;
+        os.flags(flags);
+        os.precision(precision);
+    }
+
+private:
+    std::array<std::atomic<count_type>, BUCKETS> counts {};
+    std::atomic<count_type>                     total   {};
+    std::atomic<count_type>                     sum     {};
+    std::atomic<value_type>                     largest {};
+
+    /* The power of two of the value past the first SUB_BUCKETS values */
+    static constexpr int magnitude(value_type value) noexcept
+    {
+        return std::max(0, static_cast<int>(std::bit_width(value)) - SUB_BUCKET_BITS);
+    }
+
+    static constexpr int index(value_type value) noexcept
+    {
+        int const m = magnitude(value);
+        return m * HALF_BUCKETS + static_cast<int>(value >> m);
+    }
+
+    static constexpr value_type highest_equivalent(int index) noexcept
+    {
+        int const m = index < SUB_BUCKETS ? 0 : index / HALF_BUCKETS - 1;
+        value_type const lowest = static_cast<value_type>(index - m * HALF_BUCKETS) << m;
+        return lowest + ((value_type{1} << m) - 1);
+    }
+};
+
+#endif
@@ -1,5 +1,8 @@
 #include "game.hpp"
 #include "extra.hpp"
+#include "workers.hpp"
+#include <algorithm>
+#include <vector>
 #include <iostream>
 #include <filesystem>
 
@@ -12,19 +15,68 @@ int main(int argc, char **argv)
 {
     if (argc == 2 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0))
     {
-        std::cout << "Usage: " << argv[0] << "--online" << std::endl;
+        std::cout << "Usage: " << argv[0] << " [--online] [--workers N]"
+            " [--slow-policy time-out|disconnect]" << std::endl;
         return 1;
     }
-    offline_mode();
+
+    bool online = false;
+    unsigned worker = 0, worker_count = 1;
+    std::vector<char const *> worker_args { argv[0] };
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--online") == 0)
+        {
+            online = true;
+            worker_args.push_back(argv[i]);
+        }
+        else if (strcmp(argv[i], "--slow-policy") == 0 && i + 1 < argc)
+        {
+            worker_args.push_back(argv[i]);
+            worker_args.push_back(argv[++i]);
+            game_client::player_policy = strcmp(argv[i], "disconnect") == 0 ?
+                game_client::slow_policy::disconnect : game_client::slow_policy::time_out;
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            worker_count = std::clamp(std::atoi(argv[++i]), 1, int(workers::MAX_WORKERS));
+        else if (strcmp(argv[i], "--worker") == 0 && i + 2 < argc)
+        {
+            worker = std::atoi(argv[++i]);
+            workers::become(worker, std::atoi(argv[++i]));
+        }
+    }
+    worker_args.push_back(nullptr);
+
+    if (worker_count > 1)
+        workers::supervise(worker_count, worker_args.data());
+
     std::ostream &server_log = std::cout;
 
-    std::thread debug_thread(server_debug_terminal);
-    debug_thread.detach();
+    /* The workers share the terminal, only the first one reads it */
+    if (worker == 0)
+    {
+        std::thread debug_thread(server_debug_terminal);
+        debug_thread.detach();
+    }
+
+    std::thread metrics_thread(metrics::serve, MJ_SERVER_METRICS_PORT + worker);
+    metrics_thread.detach();
+
+    game_client::listen(workers::count() > 1);
+    std::thread links_thread(game_client::serve_links);
+    links_thread.detach();
+    if (workers::count() > 1)
+    {
+        std::thread handoff_thread(workers::serve_handoffs, game::route);
+        handoff_thread.detach();
+    }
 
     std::filesystem::create_directory(GAME_LOG_DIR);
-    time(server_log) << "SERVER: starting on port " << MJ_SERVER_DEFAULT_PORT;
+    time(server_log) << "SERVER: worker " << worker << "/" << workers::count()
+        << " starting on port " << MJ_SERVER_DEFAULT_PORT
+        << ", metrics on 127.0.0.1:" << MJ_SERVER_METRICS_PORT + worker;
 
-    if (argc >= 2 && strcmp(argv[1], "--online") == 0)
+    if (online)
     {
         online_mode();
         server_log << " (online mode)" << std::endl;
@@ -41,7 +93,14 @@ int main(int argc, char **argv)
         auto id = game_id();
         ss << GAME_LOG_DIR << "/" << std::setw(4) << std::setfill('0') <<
             id << GAME_LOG_SUFFIX;
-        game::games.try_emplace(id, id, server_log, ss.str(), true);
+        /* The game is built in a map of its own while its players join, and
+         * its node moved to the games without moving the game */
+        decltype(game::games) pending;
+        pending.try_emplace(id, id, server_log, ss.str(), true);
+        {
+            std::scoped_lock lock(game::games_m);
+            game::games.insert(pending.extract(id));
+        }
 
         time(server_log) << "SERVER: new game " << id << " started" << std::endl;
     }
@@ -0,0 +1,247 @@
+#include "metrics.hpp"
+#include "game.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <poll.h>
+
+static_assert(static_cast<int>(turn_state::chombo) + 1 == metrics::STATES);
+
+namespace metrics
+{
+
+namespace
+{
+
+/* How long a scraper has to send its request, or to take the response */
+constexpr int REQUEST_TIMEOUT_MS = 1000;
+
+constexpr std::array<char const *, STATES> STATE_NAMES = {
+    "game_over", "start_round", "draw", "self_call", "discard",
+    "opponent_call", "after_kong", "next", "renchan", "exhaustive_draw",
+    "tsumogiri", "chombo"
+};
+
+/* Only written by its thread, so relaxed loads and stores are enough */
+using block = std::array<std::atomic<value_type>, COUNTERS>;
+
+struct registry
+{
+    std::mutex                              m;
+    std::vector<block const *>              live;
+    std::array<value_type, COUNTERS>        retired {};
+};
+
+registry &blocks()
+{
+    static registry r;
+    return r;
+}
+
+/* Registers itself while the thread runs, and retires its counts on exit */
+struct local_block
+{
+    block values {};
+
+    local_block()
+    {
+        std::scoped_lock lock(blocks().m);
+        blocks().live.push_back(&values);
+    }
+
+    ~local_block()
+    {
+        registry &r = blocks();
+        std::scoped_lock lock(r.m);
+        for (int i = 0; i < COUNTERS; ++i)
+            r.retired[i] += values[i].load(std::memory_order_relaxed);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &values));
+    }
+};
+
+std::array<value_type, COUNTERS> totals(std::size_t &threads)
+{
+    registry &r = blocks();
+    std::scoped_lock lock(r.m);
+    std::array<value_type, COUNTERS> sum = r.retired;
+    for (auto const *values : r.live)
+    {
+        for (int i = 0; i < COUNTERS; ++i)
+            sum[i] += (*values)[i].load(std::memory_order_relaxed);
+    }
+    threads = r.live.size();
+    return sum;
+}
+
+/* Threads of the whole process, from procfs, or 0 if it cannot be read */
+std::size_t process_threads()
+{
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key)
+    {
+        std::size_t n;
+        if (key == "Threads:" && status >> n)
+            return n;
+        status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+void header(std::ostream &os, char const *name, char const *type, char const *help)
+{
+    os << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+}
+
+void summary(std::ostream &os, char const *name, char const *labels,
+    latency_histogram const &h)
+{
+    for (double q : {0.5, 0.9, 0.99, 0.999})
+        os << name << '{' << labels << (*labels ? "," : "") << "quantile=\"" << q << "\"} "
+            << h.percentile(q * 100) / 1e6 << '\n';
+    os << name << "_sum" << (*labels ? "{" : "") << labels << (*labels ? "}" : "") << ' '
+        << h.mean() * h.count() / 1e6 << '\n';
+    os << name << "_count" << (*labels ? "{" : "") << labels << (*labels ? "}" : "") << ' '
+        << h.count() << '\n';
+}
+
+}
+
+void add(counter c, value_type n) noexcept
+{
+    thread_local local_block local;
+    auto &value = local.values[c];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void write(std::ostream &os)
+{
+    std::size_t threads;
+    auto const sum = totals(threads);
+    auto const flags = os.flags();
+    os << std::defaultfloat;
+    auto const seconds = [](value_type ns) { return ns / 1e9; };
+
+    std::size_t tables, queued = 0, queued_max = 0;
+    {
+        std::scoped_lock lock(game::games_m);
+        tables = game::games.size();
+        for (auto const &[id, g] : game::games)
+        {
+            auto const depth = g.queue_depth();
+            queued += depth;
+            queued_max = std::max(queued_max, depth);
+        }
+    }
+
+    header(os, "washizu_tables", "gauge", "Games running.");
+    os << "washizu_tables " << tables << '\n';
+
+    header(os, "washizu_clients", "gauge", "Clients connected, players and spectators.");
+    os << "washizu_clients " << sum[clients_opened] - sum[clients_closed] << '\n';
+
+    header(os, "washizu_messages_total", "counter", "Messages received and sent.");
+    os << "washizu_messages_total{direction=\"in\"} " << sum[messages_in] << '\n'
+        << "washizu_messages_total{direction=\"out\"} " << sum[messages_out] << '\n';
+
+    header(os, "washizu_bytes_total", "counter", "Bytes received and sent.");
+    os << "washizu_bytes_total{direction=\"in\"} " << sum[bytes_in] << '\n'
+        << "washizu_bytes_total{direction=\"out\"} " << sum[bytes_out] << '\n';
+
+    header(os, "washizu_outbox_dropped_total", "counter",
+        "Messages dropped because the outbox of a client was full.");
+    os << "washizu_outbox_dropped_total " << sum[outbox_dropped] << '\n';
+    header(os, "washizu_slow_disconnects_total", "counter",
+        "Clients disconnected for not reading their messages.");
+    os << "washizu_slow_disconnects_total " << sum[slow_disconnects] << '\n';
+    header(os, "washizu_resyncs_total", "counter",
+        "Snapshots sent to lagging players.");
+    os << "washizu_resyncs_total " << sum[resyncs] << '\n';
+
+    header(os, "washizu_queued_messages", "gauge", "Messages waiting in the queues of all games.");
+    os << "washizu_queued_messages " << queued << '\n';
+    header(os, "washizu_queued_messages_max", "gauge", "Messages waiting in the longest queue.");
+    os << "washizu_queued_messages_max " << queued_max << '\n';
+
+    header(os, "washizu_state_seconds_total", "counter", "Time spent handling each turn state.");
+    for (int s = 0; s < STATES; ++s)
+        os << "washizu_state_seconds_total{state=\"" << STATE_NAMES[s] << "\"} "
+            << seconds(sum[state_ns + s]) << '\n';
+
+    header(os, "washizu_score_calls_total", "counter", "Calls to mj_score.");
+    os << "washizu_score_calls_total " << sum[score_calls] << '\n';
+    header(os, "washizu_score_seconds_total", "counter", "Time spent in mj_score.");
+    os << "washizu_score_seconds_total " << seconds(sum[score_ns]) << '\n';
+
+    header(os, "washizu_threads", "gauge", "Threads of the server process.");
+    os << "washizu_threads " << process_threads() << '\n';
+    header(os, "washizu_metric_threads", "gauge", "Threads that recorded metrics.");
+    os << "washizu_metric_threads " << threads << '\n';
+
+    header(os, "washizu_rtt_seconds", "summary", "Round trip time of pings.");
+    summary(os, "washizu_rtt_seconds", "", game_client::server_rtt);
+    header(os, "washizu_decision_seconds", "summary", "Time for a player to act.");
+    for (std::size_t d = 0; d < game::server_decisions.size(); ++d)
+    {
+        std::string label = std::string("decision=\"") + game::DECISION_NAMES[d] + '"';
+        summary(os, "washizu_decision_seconds", label.c_str(), game::server_decisions[d]);
+    }
+    os.flags(flags);
+}
+
+/**
+ * A tiny HTTP/1.0 server: the request is read and ignored, then the metrics
+ * are written and the connection closed. Connections are served one at a
+ * time, so one that sends no request in REQUEST_TIMEOUT_MS is closed, and
+ * the response is written without blocking for longer.
+ */
+void serve(unsigned short port)
+{
+    using protocol = asio::ip::tcp;
+    protocol::acceptor acceptor(game_client::context,
+        protocol::endpoint(asio::ip::make_address("127.0.0.1"), port));
+
+    while (true)
+    {
+        protocol::socket socket(game_client::context);
+        try
+        {
+            acceptor.accept(socket);
+            socket.non_blocking(true);
+            pollfd ready { socket.native_handle(), POLLIN, 0 };
+            if (::poll(&ready, 1, REQUEST_TIMEOUT_MS) <= 0)
+                continue;
+            std::array<char, 1024> request;
+            socket.read_some(asio::buffer(request));
+
+            std::ostringstream body;
+            write(body);
+            std::ostringstream response;
+            response << "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " << body.str().size() << "\r\n"
+                "Connection: close\r\n\r\n" << body.str();
+            std::string const bytes = response.str();
+            for (std::size_t sent = 0; sent < bytes.size(); )
+            {
+                ready = { socket.native_handle(), POLLOUT, 0 };
+                if (::poll(&ready, 1, REQUEST_TIMEOUT_MS) <= 0)
+                    break;
+                asio::error_code ec;
+                sent += socket.write_some(asio::buffer(bytes.data() + sent, bytes.size() - sent), ec);
+                if (ec && ec != asio::error::would_block)
+                    break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Metrics endpoint raised: " << e.what() << std::endl;
+        }
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef MJ_SERVER_METRICS_HPP
+#define MJ_SERVER_METRICS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+constexpr unsigned short MJ_SERVER_METRICS_PORT = 10001;
+
+/**
+ * Counters of the server internals, exported in the Prometheus text format.
+ *
+ * Each thread adds to its own block of counters, so recording is a load and
+ * a store with no contention. A scrape sums the blocks of the live threads
+ * and what the exited threads left behind.
+ */
+namespace metrics
+{
+using value_type = std::uint64_t;
+
+/* One counter per turn_state, in the order of the enum */
+static constexpr int STATES = 12;
+
+enum counter : int
+{
+    messages_in, messages_out, bytes_in, bytes_out,
+    clients_opened, clients_closed,
+    score_calls, score_ns,
+    outbox_dropped, slow_disconnects, resyncs,
+    state_ns,                           /* first of STATES counters */
+    COUNTERS = state_ns + STATES
+};
+
+/**
+ * @brief Add to a counter of the calling thread.
+ */
+void add(counter c, value_type n = 1) noexcept;
+
+/**
+ * @brief Add a duration in nanoseconds to a counter of the calling thread.
+ */
+template <typename DurationType>
+void inline add_time(counter c, DurationType d) noexcept
+{
+    add(c, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+/**
+ * @brief Write every metric in the Prometheus text exposition format.
+ */
+void write(std::ostream &os);
+
+/**
+ * @brief Serve the metrics over HTTP on the loopback interface, one scrape
+ * at a time. Should be run on its own thread, it never returns.
+ */
+void serve(unsigned short port);
+
+}
+
+#endif
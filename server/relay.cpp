@@ -0,0 +1,91 @@
+#include "relay.hpp"
+#include "extra.hpp"
+#include <algorithm>
+#include <iostream>
+
+spectator_relay::spectator_relay()
+{
+    worker = std::thread(&spectator_relay::relaying, this);
+}
+
+spectator_relay::~spectator_relay()
+{
+    {
+        std::scoped_lock lock(m);
+        stop = true;
+    }
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void spectator_relay::subscribe(client_ptr &&client, log_ptr log, delay_type delay)
+{
+    auto const cursor = log->end();
+    {
+        std::scoped_lock lock(m);
+        incoming.push_back({std::move(client), std::move(log), cursor, delay});
+    }
+    ++spectators;
+    cv.notify_one();
+}
+
+bool spectator_relay::pump(subscription &s, clock_type::time_point now)
+{
+    if (!s.client->is_open())
+        return false;
+
+    if (s.cursor < s.log->begin())
+    {
+        time(std::cerr) << "Spectator " << s.client->uid <<
+            " fell behind the broadcast log, closing connection..." << std::endl;
+        return false;
+    }
+
+    std::array<char, BATCH_SIZE * msg::BUFFER_SIZE> batch;
+    std::size_t const room = std::min(BATCH_SIZE, s.client->outbox_space()) * msg::BUFFER_SIZE;
+    std::size_t size = 0;
+    for (auto const end = s.log->end(); s.cursor < end && size < room; ++s.cursor)
+    {
+        auto const e = s.log->read(s.cursor);
+        if (!e)
+            return false; /* overwritten while we read it */
+        if (e->time + s.delay > now)
+            break;
+        std::copy(e->data.begin(), e->data.end(), batch.begin() + size);
+        size += msg::BUFFER_SIZE;
+    }
+
+    /* Only the relay queues to a spectator but its pings, which may take the
+     * room, so what does not fit is read again next time */
+    s.cursor -= (size - s.client->send_some(batch.data(), size)) / msg::BUFFER_SIZE;
+    return s.client->is_open();
+}
+
+void spectator_relay::relaying()
+{
+    std::list<subscription> subscriptions;
+    std::unique_lock lock(m);
+    while (!stop)
+    {
+        for (auto &s : incoming)
+            subscriptions.push_back(std::move(s));
+        incoming.clear();
+        lock.unlock();
+
+        auto const now = clock_type::now();
+        for (auto it = subscriptions.begin(); it != subscriptions.end(); )
+        {
+            if (pump(*it, now))
+                ++it;
+            else
+            {
+                it = subscriptions.erase(it);
+                --spectators;
+            }
+        }
+
+        lock.lock();
+        cv.wait_for(lock, POLL_INTERVAL, [this]() { return stop || !incoming.empty(); });
+    }
+}
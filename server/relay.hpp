@@ -0,0 +1,90 @@
+#ifndef MJ_SERVER_RELAY_HPP
+#define MJ_SERVER_RELAY_HPP
+
+#include "broadcast_log.hpp"
+#include "client.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The spectator_relay class streams the broadcast logs of the games to
+ * their spectators, so that the game threads never send to spectators.
+ *
+ * @details Each spectator has a cursor in the log of its game, and the
+ * messages that are at least its delay old are queued to it in batches, as
+ * many as its outbox takes. A spectator that cannot keep up gets the messages
+ * later, and one that falls a whole log behind is disconnected, because it
+ * has missed messages. Spectators are polled every POLL_INTERVAL.
+ */
+class spectator_relay
+{
+public:
+    using client_ptr    = std::unique_ptr<game_client>;
+    using log_ptr       = std::shared_ptr<broadcast_log const>;
+    using clock_type    = broadcast_log::clock_type;
+    using delay_type    = std::chrono::milliseconds;
+
+    static constexpr std::chrono::milliseconds POLL_INTERVAL { 20 };
+    static constexpr std::size_t BATCH_SIZE = 64; /* messages per poll */
+
+public:
+    spectator_relay();
+
+    spectator_relay(spectator_relay const &) = delete;
+    spectator_relay &operator=(spectator_relay const &) = delete;
+
+    /**
+     * Stops the relay thread, the spectators are disconnected.
+     */
+    ~spectator_relay();
+
+    /**
+     * @brief Start streaming a log to a spectator, from the next message.
+     *
+     * @param client The spectator.
+     * @param log The broadcast log of the game.
+     * @param delay How old a message must be before it is sent.
+     */
+    void subscribe(client_ptr &&client, log_ptr log, delay_type delay = delay_type::zero());
+
+    /**
+     * @return The number of spectators being streamed to.
+     */
+    std::size_t size() const noexcept { return spectators.load(); }
+
+private:
+    struct subscription
+    {
+        client_ptr                  client;
+        log_ptr                     log;
+        broadcast_log::sequence_type cursor;
+        delay_type                  delay;
+    };
+
+    std::mutex                  m;
+    std::condition_variable     cv;
+    std::vector<subscription>   incoming;
+    bool                        stop = false;
+    std::atomic<std::size_t>    spectators = 0;
+    std::thread                 worker;
+
+    /**
+     * The method for the relay thread. Only it touches the subscriptions
+     * after they are taken from incoming.
+     */
+    void relaying();
+
+    /**
+     * @brief Queue what the outbox of a spectator can take.
+     *
+     * @return False if the spectator should be dropped.
+     */
+    bool pump(subscription &s, clock_type::time_point now);
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MJ_SERVER_SNAPSHOT_HPP
+#define MJ_SERVER_SNAPSHOT_HPP
+
+#include "utils/message.hpp"
+#include <array>
+#include <cstddef>
+
+/**
+ * @brief The snapshot class is the state of a game as one viewer sees it,
+ * serialized as a burst of ordinary messages, so that a client can resume a
+ * game from it in one read.
+ *
+ * @details The burst is, with the headers of utils/message.hpp:
+ *
+ *     snapshot START_STREAM
+ *     new_round, your_position (players only), current_player
+ *     dora_indicator for each indicator
+ *     for each seat:
+ *         seat, seat_score
+ *         closed_hand START_STREAM, tile for each tile, closed_hand END_STREAM
+ *         meld_low, meld_high for each meld
+ *         discarded for each discard
+ *         this_player_riichi if the seat called riichi
+ *     snapshot END_STREAM
+ *
+ * The messages are stored back to back, so the whole burst is sent with one
+ * write.
+ */
+class snapshot
+{
+public:
+    /* A full game state is about 250 messages */
+    static constexpr std::size_t MAX_MESSAGES = 320;
+
+public:
+    /**
+     * @brief Append a message. Messages past MAX_MESSAGES are dropped.
+     */
+    template <typename ObjType>
+    void push(msg::header header, ObjType obj) noexcept
+    {
+        if (count < MAX_MESSAGES)
+            messages[count++] = msg::buffer_data(header, obj);
+    }
+
+    char const *data() const noexcept { return messages.front().data(); }
+
+    /**
+     * @return The size of the burst in bytes.
+     */
+    std::size_t size() const noexcept { return count * msg::BUFFER_SIZE; }
+
+private:
+    std::array<msg::buffer, MAX_MESSAGES> messages;
+    std::size_t count = 0;
+
+    static_assert(sizeof(msg::buffer) == msg::BUFFER_SIZE,
+        "the messages of a snapshot must be back to back");
+};
+
+#endif
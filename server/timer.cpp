@@ -0,0 +1,159 @@
+#include "timer.hpp"
+#include <iostream>
+
+timer_wheel::timer_wheel() : epoch(clock_type::now())
+{
+    ticker = std::thread(&timer_wheel::ticking, this);
+}
+
+timer_wheel::~timer_wheel()
+{
+    {
+        std::scoped_lock lock(m);
+        stop = true;
+    }
+    wake_cv.notify_all();
+    if (ticker.joinable())
+        ticker.join();
+}
+
+/**
+ * If no timer is armed, the wheel may be behind the clock by a long time, and
+ * it can be moved forward for free because every slot is empty.
+ */
+void timer_wheel::arm(timer &t, std::chrono::milliseconds after)
+{
+    std::unique_lock lock(m);
+    bool const idle = armed == 0;
+    if (idle)
+        current = std::max(current, now_tick());
+
+    if (t.linked())
+        t.unlink();
+    else
+        ++armed;
+
+    /* The first tick that is not before the deadline */
+    tick_type const deadline =
+        std::chrono::ceil<tick_duration>(clock_type::now() - epoch + after).count();
+    t.expires = std::max(current, deadline);
+    t.fired = false;
+    place(t);
+    lock.unlock();
+
+    if (idle)
+        wake_cv.notify_one();
+}
+
+void timer_wheel::cancel(timer &t)
+{
+    std::unique_lock lock(m);
+    if (t.linked())
+    {
+        t.unlink();
+        --armed;
+    }
+    if (std::this_thread::get_id() != ticker.get_id())
+        done_cv.wait(lock, [this, &t]() { return running != &t; });
+}
+
+void timer_wheel::place(timer &t) noexcept
+{
+    if (t.expires < current)
+        t.expires = current;
+    if (t.expires - current > MAX_TICKS)
+        t.expires = current + MAX_TICKS;
+
+    tick_type const delta = t.expires - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >> (SLOT_BITS * (level + 1)))
+        ++level;
+
+    node &head = wheels[level][(t.expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    t.prev = head.prev;
+    t.next = &head;
+    head.prev->next = &t;
+    head.prev = &t;
+}
+
+int timer_wheel::cascade(int level, int slot) noexcept
+{
+    node &head = wheels[level][slot];
+    while (head.linked())
+    {
+        timer &t = static_cast<timer &>(*head.next);
+        t.unlink();
+        place(t);
+    }
+    return slot;
+}
+
+void timer_wheel::advance() noexcept
+{
+    int const index = current & (SLOTS - 1);
+    for (int level = 1; !index && level < LEVELS; ++level)
+    {
+        if (cascade(level, (current >> (SLOT_BITS * level)) & (SLOTS - 1)))
+            break;
+    }
+
+    node &head = wheels[0][index];
+    if (head.linked())
+    {
+        head.next->prev = expiring.prev;
+        expiring.prev->next = head.next;
+        head.prev->next = &expiring;
+        expiring.prev = head.prev;
+        head.prev = head.next = &head;
+    }
+    ++current;
+}
+
+timer_wheel::tick_type timer_wheel::now_tick() const noexcept
+{
+    return (clock_type::now() - epoch) / TICK;
+}
+
+/**
+ * The method for the thread of the wheel. It advances the wheel to the clock,
+ * runs the callbacks of the expired timers, then sleeps until the next tick,
+ * or until a timer is armed if none is.
+ */
+void timer_wheel::ticking()
+{
+    std::unique_lock lock(m);
+    while (!stop)
+    {
+        if (armed == 0)
+        {
+            wake_cv.wait(lock, [this]() { return stop || armed != 0; });
+            continue;
+        }
+
+        for (tick_type target = now_tick(); current <= target; )
+            advance();
+
+        while (expiring.linked())
+        {
+            timer &t = static_cast<timer &>(*expiring.next);
+            t.unlink();
+            --armed;
+            t.fired = true;
+            running = &t;
+            lock.unlock();
+            try
+            {
+                t.callback();
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Timer callback raised: " << e.what() << std::endl;
+            }
+            lock.lock();
+            running = nullptr;
+            done_cv.notify_all();
+        }
+
+        wake_cv.wait_until(lock, epoch + current * TICK, [this]() { return stop; });
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef MJ_SERVER_TIMER_HPP
+#define MJ_SERVER_TIMER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief The timer_wheel class is a hierarchical timing wheel shared by every
+ * game and client of the server, so that thousands of tables do not need
+ * thousands of sleeping threads or timed waits.
+ *
+ * @details There are LEVELS wheels of SLOTS slots. A slot of the first wheel
+ * is one TICK, and a slot of each next wheel is a full turn of the previous
+ * one. A timer is kept in an intrusive list in the slot of its expiry, so
+ * arming and cancelling it is O(1). When the first wheel wraps around, the
+ * next slot of the upper wheel is cascaded down. One thread advances the
+ * wheel, and sleeps when no timer is armed.
+ *
+ * Callbacks are run on the thread of the wheel, one at a time and without
+ * the lock of the wheel, so they can arm and cancel timers. They should be
+ * short: a late callback delays all the others.
+ */
+class timer_wheel
+{
+public:
+    using clock_type    = std::chrono::steady_clock;
+    using tick_type     = std::uint64_t;
+    using tick_duration = std::chrono::duration<tick_type, std::centi>;
+
+    static constexpr tick_duration TICK { 1 };
+    static constexpr int SLOT_BITS  = 6;
+    static constexpr int SLOTS      = 1 << SLOT_BITS;
+    static constexpr int LEVELS     = 4;
+    /* About 46 hours, longer timers are clamped */
+    static constexpr tick_type MAX_TICKS = (tick_type{1} << (SLOT_BITS*LEVELS)) - 1;
+
+private:
+    struct node
+    {
+        node *prev = this;
+        node *next = this;
+
+        bool linked() const noexcept { return next != this; }
+        void unlink() noexcept
+        {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+    };
+
+public:
+    /**
+     * @brief A timer of a wheel, which calls the callback when it expires. A
+     * timer is armed at most once at a time: arming it again moves its
+     * deadline.
+     *
+     * @note The callback must not use anything destroyed before the timer.
+     * The timer is cancelled when it is destroyed.
+     */
+    class timer : private node
+    {
+    public:
+        timer(timer_wheel &wheel, std::function<void()> callback)
+            : wheel(wheel), callback(std::move(callback)) {}
+
+        timer(timer const &) = delete;
+        timer &operator=(timer const &) = delete;
+
+        ~timer() { cancel(); }
+
+        /**
+         * @brief Arm the timer to expire after the given duration, which is
+         * rounded up to the tick.
+         */
+        template <typename DurationType>
+        void arm(DurationType after)
+        {
+            wheel.arm(*this, std::chrono::ceil<std::chrono::milliseconds>(after));
+        }
+
+        /**
+         * @brief Disarm the timer. If the callback is running on another
+         * thread, wait for it to return.
+         */
+        void cancel() { wheel.cancel(*this); }
+
+        /**
+         * @return If the timer expired since it was last armed.
+         */
+        bool inline expired() const noexcept { return fired.load(); }
+
+    private:
+        friend class timer_wheel;
+
+        timer_wheel &wheel;
+        std::function<void()> callback;
+        tick_type expires = 0;
+        std::atomic<bool> fired = false;
+    };
+
+public:
+    timer_wheel();
+
+    timer_wheel(timer_wheel const &) = delete;
+    timer_wheel &operator=(timer_wheel const &) = delete;
+
+    /**
+     * Stops the thread of the wheel. Timers still armed never expire.
+     */
+    ~timer_wheel();
+
+    /**
+     * @return The number of armed timers.
+     */
+    std::size_t size() const noexcept { return armed.load(); }
+
+private:
+    std::array<std::array<node, SLOTS>, LEVELS> wheels;
+    node                                        expiring;
+    tick_type                                   current = 0;
+    clock_type::time_point                      epoch;
+
+    mutable std::mutex                          m;
+    std::condition_variable                     wake_cv;
+    std::condition_variable                     done_cv;
+    timer const *                               running = nullptr;
+    std::atomic<std::size_t>                    armed   = 0;
+    bool                                        stop    = false;
+    std::thread                                 ticker;
+
+    void arm(timer &t, std::chrono::milliseconds after);
+    void cancel(timer &t);
+
+    /* Put the timer in the slot of its expiry, with the lock held */
+    void place(timer &t) noexcept;
+    /* Move the timers of the slot to lower wheels, returns the slot index */
+    int cascade(int level, int slot) noexcept;
+    /* Move the timers of the current tick to the expiring list */
+    void advance() noexcept;
+
+    tick_type now_tick() const noexcept;
+    void ticking();
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "workers.hpp"
+#include "extra.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace workers
+{
+
+namespace
+{
+
+unsigned worker_index = 0;
+unsigned worker_count = 1;
+
+/* What is sent along with the socket of a client */
+struct handoff
+{
+    game_id_type        id;
+    game_client::id_type uid;
+    bool                as_player;
+};
+
+/* Handed off clients are routed to their game, which redirects players to
+ * its queue. Spectators have nothing to say, so theirs is never read. */
+std::condition_variable sink_cv;
+game_client::queue_type sink { sink_cv };
+
+/**
+ * The handoff socket of a worker, in the abstract namespace so there is no
+ * file to clean up when a worker dies.
+ */
+socklen_t address(unsigned worker, sockaddr_un &addr) noexcept
+{
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    std::string const name = "washizu-" + std::to_string(MJ_SERVER_DEFAULT_PORT)
+        + "-" + std::to_string(worker);
+    std::memcpy(addr.sun_path + 1, name.data(), name.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+pid_t spawn(unsigned worker, unsigned count, char const *const *args)
+{
+    pid_t const pid = fork();
+    if (pid != 0)
+        return pid;
+
+    std::vector<char *> argv;
+    for (auto *arg = args; *arg; ++arg)
+        argv.push_back(const_cast<char *>(*arg));
+    std::string index_arg = std::to_string(worker), count_arg = std::to_string(count);
+    argv.push_back(const_cast<char *>("--worker"));
+    argv.push_back(index_arg.data());
+    argv.push_back(count_arg.data());
+    argv.push_back(nullptr);
+
+    execv("/proc/self/exe", argv.data());
+    time(std::cerr) << "SUPERVISOR: cannot start worker " << worker << ": "
+        << std::strerror(errno) << std::endl;
+    _exit(EXIT_FAILURE);
+}
+
+}
+
+unsigned count() noexcept { return worker_count; }
+
+unsigned index() noexcept { return worker_index; }
+
+void become(unsigned index, unsigned count) noexcept
+{
+    worker_index = index;
+    worker_count = count ? count : 1;
+}
+
+/**
+ * The workers are new processes rather than plain forks, because the static
+ * services (timer wheel, relay) run threads that a fork would not copy.
+ * A worker that exits is restarted after a second, its games are lost.
+ */
+void supervise(unsigned count, char const *const *args)
+{
+    std::vector<pid_t> pids(count);
+    for (unsigned i = 0; i < count; ++i)
+        pids[i] = spawn(i, count, args);
+    time(std::cout) << "SUPERVISOR: started " << count << " workers" << std::endl;
+
+    while (true)
+    {
+        int status;
+        pid_t const pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            if (pids[i] != pid)
+                continue;
+            time(std::cerr) << "SUPERVISOR: worker " << i << " exited with "
+                << status << ", restarting..." << std::endl;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            pids[i] = spawn(i, count, args);
+        }
+    }
+}
+
+void hand_off(client_ptr &&client, game_id_type id, bool as_player)
+{
+    handoff h { id, client->uid, as_player };
+    iovec iov { &h, sizeof h };
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    sockaddr_un addr;
+    msghdr m {};
+    m.msg_name = &addr;
+    m.msg_namelen = address(owner(id), addr);
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof control;
+
+    cmsghdr *c = CMSG_FIRSTHDR(&m);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    int const client_socket = client->native_handle();
+    std::memcpy(CMSG_DATA(c), &client_socket, sizeof client_socket);
+
+    int const fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    bool const sent = fd >= 0 && sendmsg(fd, &m, 0) == sizeof h;
+    int const error = errno;
+    if (fd >= 0)
+        ::close(fd);
+
+    if (!sent)
+    {
+        time(std::cerr) << "WORKER: cannot hand " << client->uid << " to worker "
+            << owner(id) << ": " << std::strerror(error) << std::endl;
+        client->reject();
+        return;
+    }
+
+    time(std::cout) << "WORKER: handed " << client->uid << " to worker "
+        << owner(id) << " for game " << id << std::endl;
+    /* The owner has its own copy of the socket, this one only is closed */
+    client->close();
+}
+
+void serve_handoffs(route_type route)
+{
+    sockaddr_un addr;
+    socklen_t const length = address(index(), addr);
+    int const fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int const pass_credentials = 1;
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), length) < 0
+        || setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &pass_credentials, sizeof pass_credentials) < 0)
+    {
+        time(std::cerr) << "WORKER: cannot receive handoffs: "
+            << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    /* The name is abstract, anyone can send to it: the kernel attaches the
+     * credentials of the sender, and only the user of the server is heard */
+    uid_t const server_uid = geteuid();
+    while (true)
+    {
+        handoff h;
+        iovec iov { &h, sizeof h };
+        alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int)) + CMSG_SPACE(sizeof(ucred))] {};
+        msghdr m {};
+        m.msg_iov = &iov;
+        m.msg_iovlen = 1;
+        m.msg_control = control;
+        m.msg_controllen = sizeof control;
+
+        ssize_t const n = recvmsg(fd, &m, MSG_CMSG_CLOEXEC);
+        if (n < 0)
+            continue;
+
+        int client_socket = -1;
+        bool same_user = false;
+        for (cmsghdr *c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c))
+        {
+            if (c->cmsg_level != SOL_SOCKET)
+                continue;
+            if (c->cmsg_type == SCM_RIGHTS)
+            {
+                /* Only one socket is handed off at a time, more are closed */
+                std::size_t const fds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (std::size_t i = 0; i < fds; ++i)
+                {
+                    int received;
+                    std::memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof received);
+                    if (client_socket < 0 && fds == 1)
+                        client_socket = received;
+                    else
+                        ::close(received);
+                }
+            }
+            else if (c->cmsg_type == SCM_CREDENTIALS)
+            {
+                ucred cred;
+                std::memcpy(&cred, CMSG_DATA(c), sizeof cred);
+                same_user = cred.uid == server_uid;
+            }
+        }
+        if (client_socket < 0)
+            continue;
+        if (n != sizeof h || !same_user || (m.msg_flags & MSG_CTRUNC))
+        {
+            ::close(client_socket);
+            continue;
+        }
+
+        auto client = std::make_unique<game_client>(sink, client_socket, h.uid);
+        if (client->is_open())
+            route(std::move(client), h.id, h.as_player);
+    }
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef MJ_SERVER_WORKERS_HPP
+#define MJ_SERVER_WORKERS_HPP
+
+#include "client.hpp"
+#include <functional>
+#include <memory>
+
+/**
+ * Horizontal scaling over worker processes.
+ *
+ * A supervisor starts the workers, which all accept on the server port with
+ * SO_REUSEPORT, so the kernel spreads the connections over them. Each game
+ * lives in one worker, and its id tells which one (see owner). A reconnect or
+ * spectate request that lands on another worker is handed to the owner: the
+ * socket itself is passed over a unix datagram socket, so the client keeps
+ * its connection and never knows.
+ *
+ * Without a supervisor there is one worker, and nothing is ever handed off.
+ */
+namespace workers
+{
+using game_id_type  = unsigned short;
+using client_ptr    = std::unique_ptr<game_client>;
+using route_type    = std::function<void(client_ptr &&, game_id_type, bool)>;
+
+static constexpr unsigned MAX_WORKERS = 64;
+
+/**
+ * @return The number of worker processes, 1 without a supervisor.
+ */
+unsigned count() noexcept;
+
+/**
+ * @return The index of this worker, from 0 to count() - 1.
+ */
+unsigned index() noexcept;
+
+/**
+ * @brief Make this process the worker at index out of count.
+ */
+void become(unsigned index, unsigned count) noexcept;
+
+/**
+ * @return The index of the worker that runs the game.
+ */
+unsigned inline owner(game_id_type id) noexcept { return id % count(); }
+
+/**
+ * @brief Start count workers, by running this executable again with the given
+ * arguments followed by "--worker <index> <count>", and restart the ones that
+ * exit. It never returns.
+ */
+[[noreturn]] void supervise(unsigned count, char const *const *args);
+
+/**
+ * @brief Pass the socket of a client to the worker that owns the game. The
+ * client is closed here either way, and rejected if the owner is unreachable.
+ * The listening thread of the client must not be started.
+ */
+void hand_off(client_ptr &&client, game_id_type id, bool as_player);
+
+/**
+ * @brief Receive the clients handed off to this worker and route them. Should
+ * be run on its own thread, it only returns if the handoff socket cannot be
+ * bound.
+ */
+void serve_handoffs(route_type route);
+
+}
+
+#endif
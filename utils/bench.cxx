@@ -0,0 +1,183 @@
+#include "utils/optim.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+/*
+ * Microbenchmark of the containers of the game state, played the way the
+ * server plays a round.
+ *
+ * Usage: BenchOptim [-s seed] [-r rounds] [-t]
+ *
+ * Each round clears the discard piles and the doras, then every turn pushes
+ * a discard and builds the call tiles of opponent_call, which are pushed by
+ * the callers. The containers are the ones of the server (small_vector) and
+ * std::vector reserved the same way, for comparison. -t prints tab separated
+ * values instead of the table.
+ *
+ * Allocations are counted by replacing the global operator new, and only the
+ * rounds are counted, not the construction of the game.
+ */
+
+static unsigned long long allocations;
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+/* xorshift64*, so the rounds only depend on the seed */
+static unsigned long long rng_state;
+
+static unsigned rng(unsigned bound)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 0x2545f4914f6cdd1dULL) >> 32) % bound;
+}
+
+constexpr int NUM_PLAYERS            = 4;
+constexpr int MAX_DISCARD_PER_PLAYER = 24;
+constexpr int MAX_DORAS              = 5;
+constexpr int TURNS                  = 70;
+
+using card_type = unsigned short;
+
+struct small_state
+{
+    std::array<small_vector<card_type, MAX_DISCARD_PER_PLAYER>, NUM_PLAYERS> discards;
+    small_vector<card_type, MAX_DORAS*2> doras;
+    using call_tiles_type = std::array<small_vector<card_type, NUM_PLAYERS>, NUM_PLAYERS - 1>;
+};
+
+struct vector_state
+{
+    std::array<std::vector<card_type>, NUM_PLAYERS> discards;
+    std::vector<card_type> doras;
+    using call_tiles_type = std::array<std::vector<card_type>, NUM_PLAYERS - 1>;
+
+    vector_state()
+    {
+        for (auto &pile : discards)
+            pile.reserve(MAX_DISCARD_PER_PLAYER);
+        doras.reserve(2*MAX_DORAS);
+    }
+};
+
+struct result
+{
+    char const *name;
+    unsigned long long allocations;
+    double ns_per_turn;
+    unsigned long long checksum;
+};
+
+template <typename State>
+static result play(char const *name, State &state, unsigned long long seed, int rounds)
+{
+    rng_state = seed;
+    unsigned long long checksum = 0;
+    unsigned long long const start_allocations = allocations;
+    auto const start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (auto &pile : state.discards)
+            pile.clear();
+        state.doras.clear();
+        state.doras.push_back(rng(512));
+
+        for (int turn = 0; turn < TURNS; ++turn)
+        {
+            int const player = turn % NUM_PLAYERS;
+            card_type const tile = rng(512);
+
+            typename State::call_tiles_type call_tiles;
+            for (int caller = 0; caller < NUM_PLAYERS - 1; ++caller)
+            {
+                if (rng(8))
+                    continue;
+                int const tiles = 2 + rng(2);
+                while ((int)call_tiles[caller].size() < tiles)
+                    call_tiles[caller].push_back(rng(512));
+            }
+            for (auto const &tiles : call_tiles)
+                for (auto t : tiles)
+                    checksum += t;
+
+            if (state.discards[player].size() < MAX_DISCARD_PER_PLAYER)
+                state.discards[player].push_back(tile);
+            if (!rng(32) && state.doras.size() < MAX_DORAS)
+                state.doras.push_back(rng(512));
+        }
+
+        for (auto const &pile : state.discards)
+            for (auto t : pile)
+                checksum += t;
+        for (auto t : state.doras)
+            checksum += t;
+    }
+
+    std::chrono::duration<double, std::nano> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    return { name, allocations - start_allocations,
+        elapsed.count() / ((double)rounds * TURNS), checksum };
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long seed = 0x5eed;
+    int rounds = 100000;
+    bool tsv = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t"))
+            tsv = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s seed] [-r rounds] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto small = std::make_unique<small_state>();
+    auto vector = std::make_unique<vector_state>();
+    result const results[] = {
+        play("small_vector", *small, seed, rounds),
+        play("std::vector", *vector, seed, rounds),
+    };
+
+    if (!tsv)
+        printf("%-14s %14s %14s %12s %20s\n",
+            "container", "allocations", "allocs/round", "ns/turn", "checksum");
+    for (auto const &r : results)
+    {
+        if (tsv)
+            printf("%s\t%llu\t%.4f\t%.2f\t%llu\n", r.name, r.allocations,
+                (double)r.allocations / rounds, r.ns_per_turn, r.checksum);
+        else
+            printf("%-14s %14llu %14.4f %12.2f %20llu\n", r.name, r.allocations,
+                (double)r.allocations / rounds, r.ns_per_turn, r.checksum);
+    }
+
+    /* The checksums only differ if the containers do */
+    return results[0].checksum == results[1].checksum && results[0].allocations == 0 ? 0 : 1;
+}
@@ -61,6 +61,7 @@ enum class header : char
     call_tenpai             = 'i',
 
     ping                    = ';', /* random number (16 bit) */
+    shared_memory           = 'm', /* worker index, see utils/shm.hpp */
 
     reject                  = 'X', /* magic number */
     queue_size              = 'Q', /* number (1,2,3,4) */
@@ -88,6 +89,15 @@ enum class header : char
     game_draw               = 'E', /* No Info */
     new_round               = 'N', /* direction + 4*wind */
 
+    /* Only in a snapshot, see server/snapshot.hpp */
+    snapshot                = 'S', /* stream */
+    current_player          = 'o', /* player */
+    seat                    = 'A', /* player */
+    seat_score              = 'z', /* points / 100 */
+    meld_low                = 'L', /* low 16 bits of the triple */
+    meld_high               = 'l', /* high 16 bits of the triple */
+    discarded               = 'v', /* 9 bit tile unique ID */
+
     timeout                 = '\0'
 };
 
@@ -206,9 +216,18 @@ public:
      */
     bool inline empty() const noexcept { return container.empty(); }
 
+    /**
+     * @return The number of messages in the queue.
+     */
+    std::size_t inline size() const noexcept
+    {
+        std::scoped_lock lock(mutex);
+        return container.size();
+    }
+
 private:
     container_type container {};
-    std::mutex mutex;
+    mutable std::mutex mutex;
     std::condition_variable &notification;
 };
 
@@ -6,34 +6,241 @@
 #ifndef MJ_UTILS_OPTIM_HPP
 #define MJ_UTILS_OPTIM_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-template <std::size_t MaxSize>
-struct optim
+/**
+ * @brief A vector that keeps up to InlineSize elements inside itself, and only
+ * allocates when it grows past them.
+ *
+ * @details The elements live in the inline buffer until the first push beyond
+ * InlineSize, then they are moved to the heap, and stay there until the vector
+ * is destroyed (clear keeps the capacity, like std::vector). Copies and moves
+ * copy or move the elements, never the buffer, so a small_vector can be stored
+ * in any container. Iterators are pointers, invalidated like those of
+ * std::vector.
+ *
+ * @tparam Type The type of the elements.
+ * @tparam InlineSize The number of elements stored without allocating.
+ */
+template <typename Type, std::size_t InlineSize>
+class small_vector
 {
-    optim() = delete;
+public:
+    using value_type        = Type;
+    using size_type         = std::size_t;
+    using difference_type   = std::ptrdiff_t;
+    using reference         = Type &;
+    using const_reference   = Type const &;
+    using pointer           = Type *;
+    using const_pointer     = Type const *;
+    using iterator          = Type *;
+    using const_iterator    = Type const *;
+    using reverse_iterator  = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    static constexpr size_type inline_capacity = InlineSize;
+
+    static_assert(InlineSize > 0, "use std::vector when nothing is inline");
+
+public:
+    small_vector() noexcept = default;
+
+    small_vector(std::initializer_list<Type> init)
+    {
+        reserve(init.size());
+        for (auto const &elem : init)
+            push_back(elem);
+    }
+
+    small_vector(small_vector const &other)
+    {
+        reserve(other.count);
+        std::uninitialized_copy(other.begin(), other.end(), first);
+        count = other.count;
+    }
+
+    small_vector(small_vector &&other) noexcept(std::is_nothrow_move_constructible_v<Type>)
+    {
+        take(std::move(other));
+    }
+
+    ~small_vector()
+    {
+        clear();
+        release();
+    }
+
+    small_vector &operator=(small_vector const &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other.count);
+            std::uninitialized_copy(other.begin(), other.end(), first);
+            count = other.count;
+        }
+        return *this;
+    }
+
+    small_vector &operator=(small_vector &&other)
+        noexcept(std::is_nothrow_move_constructible_v<Type>)
+    {
+        if (this != &other)
+        {
+            clear();
+            release();
+            take(std::move(other));
+        }
+        return *this;
+    }
+
+    iterator begin() noexcept { return first; }
+    iterator end() noexcept { return first + count; }
+    const_iterator begin() const noexcept { return first; }
+    const_iterator end() const noexcept { return first + count; }
+    const_iterator cbegin() const noexcept { return first; }
+    const_iterator cend() const noexcept { return first + count; }
+    reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+    reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+    size_type size() const noexcept { return count; }
+    size_type capacity() const noexcept { return cap; }
+    bool empty() const noexcept { return count == 0; }
 
     /**
-     * @brief Allocators for allocating vectors below a certain size on the stack.
+     * @return If the elements are still in the inline buffer.
      */
-    template <typename Type>
-    struct allocator : public std::allocator<Type>
+    bool is_inline() const noexcept { return first == local(); }
+
+    Type *data() noexcept { return first; }
+    Type const *data() const noexcept { return first; }
+
+    reference operator[](size_type i) noexcept { return first[i]; }
+    const_reference operator[](size_type i) const noexcept { return first[i]; }
+    reference front() noexcept { return first[0]; }
+    const_reference front() const noexcept { return first[0]; }
+    reference back() noexcept { return first[count - 1]; }
+    const_reference back() const noexcept { return first[count - 1]; }
+
+    void reserve(size_type n)
+    {
+        if (n > cap)
+            grow(n);
+    }
+
+    void push_back(Type const &elem) { emplace_back(elem); }
+    void push_back(Type &&elem) { emplace_back(std::move(elem)); }
+
+    template <typename... Args>
+    reference emplace_back(Args &&...args)
     {
-        Type *allocate(size_t n)
+        Type *elem;
+        if (count < cap)
+            elem = std::construct_at(first + count, std::forward<Args>(args)...);
+        else
         {
-            if (n > MaxSize)
-                return new Type[n];
-            return data;
+            /* The new element is built before the others are moved, args may
+             * be one of them: v.push_back(v[0]) */
+            size_type const n = 2 * cap;
+            Type *heap = std::allocator<Type>().allocate(n);
+            try
+            {
+                elem = std::construct_at(heap + count, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                std::allocator<Type>().deallocate(heap, n);
+                throw;
+            }
+            move_to(heap, n);
         }
+        ++count;
+        return *elem;
+    }
+
+    void pop_back() noexcept { std::destroy_at(first + --count); }
+
+    /**
+     * @brief Erase an element, the ones after it are moved down.
+     */
+    iterator erase(const_iterator pos)
+    {
+        iterator it = first + (pos - first);
+        std::move(it + 1, end(), it);
+        pop_back();
+        return it;
+    }
+
+    /**
+     * @brief Destroy the elements, the capacity is kept.
+     */
+    void clear() noexcept
+    {
+        std::destroy(first, first + count);
+        count = 0;
+    }
+
+private:
+    alignas(Type) std::byte buffer[InlineSize * sizeof(Type)];
+    Type       *first   = local();
+    size_type   count   = 0;
+    size_type   cap     = InlineSize;
+
+    Type *local() noexcept { return std::launder(reinterpret_cast<Type *>(buffer)); }
+    Type const *local() const noexcept
+    {
+        return std::launder(reinterpret_cast<Type const *>(buffer));
+    }
+
+    /* Move the elements to a heap buffer of n elements */
+    void grow(size_type n)
+    {
+        move_to(std::allocator<Type>().allocate(n), n);
+    }
+
+    /* Move the elements to heap, a buffer of n elements, which is kept */
+    void move_to(Type *heap, size_type n)
+    {
+        std::uninitialized_move(first, first + count, heap);
+        std::destroy(first, first + count);
+        release();
+        first = heap;
+        cap = n;
+    }
 
-        void deallocate(Type *ptr, size_t n)
+    /* Free the heap buffer, the elements must be destroyed */
+    void release() noexcept
+    {
+        if (!is_inline())
+            std::allocator<Type>().deallocate(first, cap);
+        first = local();
+        cap = InlineSize;
+    }
+
+    /* Take the elements of other, which is left empty. this must be empty
+     * and inline. */
+    void take(small_vector &&other)
+    {
+        if (other.is_inline())
         {
-            if (n > MaxSize)
-                delete[] ptr;
+            std::uninitialized_move(other.begin(), other.end(), first);
+            count = other.count;
+            other.clear();
+            return;
         }
-    private:
-        Type data[MaxSize];
-    };
+        first = std::exchange(other.first, other.local());
+        count = std::exchange(other.count, 0);
+        cap = std::exchange(other.cap, InlineSize);
+    }
 };
 
 #endif
@@ -0,0 +1,393 @@
+/**
+ * A local transport for the clients that run on the same machine as the
+ * server, bots mostly: the messages go through rings in shared memory rather
+ * than through the loopback.
+ *
+ * The client creates the memory (a memfd) and two eventfds, one per direction,
+ * and passes them to the server over a unix socket. From then on each side
+ * writes its messages to one ring and reads the other. A reader spins for a
+ * while on an empty ring, then sleeps on its eventfd, which the writer only
+ * signals when the reader sleeps, so a busy link makes no system call.
+ */
+
+#ifndef MJ_UTILS_SHM_HPP
+#define MJ_UTILS_SHM_HPP
+
+#include "message.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace shm
+{
+
+/**
+ * @brief A single producer, single consumer ring of messages. It lives in the
+ * shared memory, so it only holds lock-free atomics and plain messages.
+ */
+struct ring
+{
+    static constexpr std::uint32_t CAPACITY = 4096;
+
+    /* Next message to read, only written by the consumer */
+    alignas(64) std::atomic<std::uint32_t> head { 0 };
+    /* Next message to write, only written by the producer */
+    alignas(64) std::atomic<std::uint32_t> tail { 0 };
+    /* The consumer sleeps on its eventfd and must be signaled */
+    alignas(64) std::atomic<std::uint32_t> sleeping { 0 };
+    std::array<msg::buffer, CAPACITY> slots;
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+    "the rings are shared between processes");
+
+/**
+ * The shared memory of a link.
+ */
+struct region
+{
+    ring to_server;
+    ring to_client;
+    std::atomic<std::uint32_t> closed { 0 };
+};
+
+/**
+ * The memfd, the eventfd of to_server and the eventfd of to_client.
+ */
+using handles_type = std::array<int, 3>;
+
+/**
+ * @brief One end of a link, which sends to one ring and receives from the
+ * other. send and recv may be called from two different threads, but there is
+ * one sender and one receiver at a time.
+ */
+class link
+{
+public:
+    enum class end { server, client };
+
+    /* Empty polls of the ring before sleeping, when the other end may run at
+     * the same time: on a single cpu, spinning only delays it */
+    static constexpr int SPIN = 4000;
+
+    /**
+     * @brief Create the memory and the eventfds, for the client end.
+     *
+     * @return The link, or empty optional if the system is out of something.
+     */
+    static std::optional<link> create() noexcept
+    {
+        handles_type h { -1, -1, -1 };
+        h[0] = memfd_create("washizu-link", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        h[1] = eventfd(0, EFD_CLOEXEC);
+        h[2] = eventfd(0, EFD_CLOEXEC);
+        /* Sealed at its size, so the server can trust it stays mapped */
+        if (h[0] < 0 || h[1] < 0 || h[2] < 0 || ftruncate(h[0], sizeof(region)) < 0
+            || fcntl(h[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+        {
+            close_all(h);
+            return std::nullopt;
+        }
+
+        void *mem = mmap(nullptr, sizeof(region), PROT_READ | PROT_WRITE, MAP_SHARED, h[0], 0);
+        if (mem == MAP_FAILED)
+        {
+            close_all(h);
+            return std::nullopt;
+        }
+        return link(new (mem) region, end::client, h);
+    }
+
+    /**
+     * @brief Map the memory of a link created by the other end. The handles
+     * belong to the link, even if it fails.
+     *
+     * @details The memory must hold a region and be sealed against shrinking:
+     * touching a page past the end of the file would kill this process.
+     */
+    static std::optional<link> adopt(end side, handles_type h) noexcept
+    {
+        struct stat st;
+        int const seals = fcntl(h[0], F_GET_SEALS);
+        if (fstat(h[0], &st) < 0 || st.st_size < static_cast<off_t>(sizeof(region))
+            || seals < 0 || !(seals & F_SEAL_SHRINK))
+        {
+            close_all(h);
+            return std::nullopt;
+        }
+
+        void *mem = mmap(nullptr, sizeof(region), PROT_READ | PROT_WRITE, MAP_SHARED, h[0], 0);
+        if (mem == MAP_FAILED)
+        {
+            close_all(h);
+            return std::nullopt;
+        }
+        return link(static_cast<region *>(mem), side, h);
+    }
+
+    link(link const &) = delete;
+
+    link(link &&other) noexcept
+        : r(std::exchange(other.r, nullptr)), side(other.side),
+          handles(std::exchange(other.handles, { -1, -1, -1 }))
+    {}
+
+    link &operator=(link &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            r = std::exchange(other.r, nullptr);
+            side = other.side;
+            handles = std::exchange(other.handles, { -1, -1, -1 });
+        }
+        return *this;
+    }
+
+    ~link() noexcept { release(); }
+
+    /**
+     * @brief Write a message, and wake the other end if it sleeps.
+     *
+     * @return false if the ring is full or the link closed.
+     */
+    bool send(msg::buffer const &buf) noexcept
+    {
+        ring &out = outgoing();
+        std::uint32_t const tail = out.tail.load(std::memory_order_relaxed);
+        if (!is_open() || tail - out.head.load(std::memory_order_acquire) == ring::CAPACITY)
+            return false;
+
+        out.slots[tail % ring::CAPACITY] = buf;
+        /* Ordered with the load of sleeping, against the store of the reader */
+        out.tail.store(tail + 1, std::memory_order_seq_cst);
+        if (out.sleeping.load(std::memory_order_seq_cst))
+            signal(out_fd());
+        return true;
+    }
+
+    /**
+     * @return The next message, or empty optional if there is none yet.
+     */
+    std::optional<msg::buffer> try_recv() noexcept
+    {
+        ring &in = incoming();
+        std::uint32_t const head = in.head.load(std::memory_order_relaxed);
+        if (head == in.tail.load(std::memory_order_seq_cst))
+            return std::nullopt;
+
+        msg::buffer const buf = in.slots[head % ring::CAPACITY];
+        in.head.store(head + 1, std::memory_order_release);
+        return buf;
+    }
+
+    /**
+     * @brief Wait for the next message, spinning first then sleeping.
+     *
+     * @param also A descriptor that also ends the wait when it is readable,
+     * such as the socket of the session, or -1.
+     * @param timeout The longest sleep in milliseconds, -1 for none.
+     * @return The message, or empty optional if the link closed, also became
+     * readable or the timeout expired.
+     */
+    std::optional<msg::buffer> recv(int also = -1, int timeout = -1) noexcept
+    {
+        static int const spin = std::thread::hardware_concurrency() > 1 ? SPIN : 0;
+        for (int i = 0; i < spin && is_open(); ++i)
+        {
+            if (auto buf = try_recv())
+                return buf;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        ring &in = incoming();
+        while (true)
+        {
+            in.sleeping.store(1, std::memory_order_seq_cst);
+            auto buf = try_recv();
+            if (buf || !is_open())
+            {
+                in.sleeping.store(0, std::memory_order_relaxed);
+                return buf;
+            }
+
+            pollfd fds[2] { { in_fd(), POLLIN, 0 }, { also, POLLIN, 0 } };
+            int const n = poll(fds, also >= 0 ? 2 : 1, timeout);
+            in.sleeping.store(0, std::memory_order_relaxed);
+            if (fds[0].revents & POLLIN)
+            {
+                std::uint64_t count;
+                [[maybe_unused]] auto _ = ::read(in_fd(), &count, sizeof count);
+            }
+
+            if ((buf = try_recv()))
+                return buf;
+            if (n == 0 || !is_open() || (n > 0 && fds[1].revents))
+                return std::nullopt;
+        }
+    }
+
+    /**
+     * @brief Mark the link closed and wake both ends. The memory stays mapped
+     * until the link is destroyed.
+     */
+    void close() noexcept
+    {
+        if (!r)
+            return;
+        r->closed.store(1);
+        signal(handles[1]);
+        signal(handles[2]);
+    }
+
+    bool is_open() const noexcept { return r && !r->closed.load(std::memory_order_relaxed); }
+
+    handles_type const &fds() const noexcept { return handles; }
+
+private:
+    region       *r;
+    end           side;
+    handles_type  handles;
+
+    link(region *mem, end e, handles_type h) noexcept
+        : r(mem), side(e), handles(h)
+    {}
+
+    ring &incoming() noexcept { return side == end::server ? r->to_server : r->to_client; }
+    ring &outgoing() noexcept { return side == end::server ? r->to_client : r->to_server; }
+    int in_fd() const noexcept { return side == end::server ? handles[1] : handles[2]; }
+    int out_fd() const noexcept { return side == end::server ? handles[2] : handles[1]; }
+
+    static void signal(int fd) noexcept
+    {
+        std::uint64_t const one = 1;
+        [[maybe_unused]] auto _ = ::write(fd, &one, sizeof one);
+    }
+
+    static void close_all(handles_type const &h) noexcept
+    {
+        for (int fd : h)
+            if (fd >= 0)
+                ::close(fd);
+    }
+
+    void release() noexcept
+    {
+        if (r)
+            munmap(r, sizeof(region));
+        close_all(handles);
+        r = nullptr;
+        handles = { -1, -1, -1 };
+    }
+};
+
+/**
+ * The unix socket where a worker of the server takes the links, in the
+ * abstract namespace.
+ */
+inline socklen_t address(unsigned short port, unsigned worker, sockaddr_un &addr) noexcept
+{
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    std::string const name = "washizu-link-" + std::to_string(port)
+        + "-" + std::to_string(worker);
+    std::memcpy(addr.sun_path + 1, name.data(), name.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+/**
+ * @return Whether the peer of a connected unix socket runs as the user of this
+ * process. The socket names are abstract, so anyone on the machine can connect.
+ */
+inline bool same_user(int sock) noexcept
+{
+    ucred cred;
+    socklen_t length = sizeof cred;
+    return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0
+        && length == sizeof cred && cred.uid == geteuid();
+}
+
+/**
+ * @brief Send the handles of a link with some data, in one message.
+ */
+inline bool send_handles(int sock, handles_type const &h, void const *data, std::size_t size) noexcept
+{
+    iovec iov { const_cast<void *>(data), size };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof h)] {};
+    msghdr m {};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof control;
+
+    cmsghdr *c = CMSG_FIRSTHDR(&m);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof h);
+    std::memcpy(CMSG_DATA(c), h.data(), sizeof h);
+    return sendmsg(sock, &m, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+/**
+ * @brief Receive the handles of a link and the data sent with them.
+ *
+ * @return The handles, or empty optional if the message is not a link.
+ */
+inline std::optional<handles_type> recv_handles(int sock, void *data, std::size_t size) noexcept
+{
+    handles_type h;
+    iovec iov { data, size };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof h)] {};
+    msghdr m {};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof control;
+
+    ssize_t const n = recvmsg(sock, &m, MSG_CMSG_CLOEXEC);
+    cmsghdr *c = CMSG_FIRSTHDR(&m);
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        return std::nullopt;
+    if (c->cmsg_len != CMSG_LEN(sizeof h))
+    {
+        /* Not the handles of a link, the descriptors are closed all the same */
+        std::size_t const fds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (std::size_t i = 0; i < fds; ++i)
+        {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof fd);
+            ::close(fd);
+        }
+        return std::nullopt;
+    }
+
+    std::memcpy(h.data(), CMSG_DATA(c), sizeof h);
+    if (n != (ssize_t)size)
+    {
+        for (int fd : h)
+            ::close(fd);
+        return std::nullopt;
+    }
+    return h;
+}
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "utils/optim.hpp"
+#include <cassert>
+#include <string>
+
+/*
+ * Tests of the containers of utils/optim.hpp.
+ *
+ * The strings are too long for the small string optimisation, so a string
+ * that was moved from, or freed, does not compare equal anymore.
+ */
+
+static std::string const long_a(64, 'a'), long_b(64, 'b');
+
+/* Pushing one of its own elements when full, the vector moves to a new buffer */
+static void test_self_insertion()
+{
+    small_vector<std::string, 2> v { long_a, long_b };
+    assert(v.is_inline() && v.size() == v.capacity());
+
+    v.push_back(v[0]);
+    assert(!v.is_inline() && v.size() == 3);
+    assert(v[0] == long_a && v[1] == long_b && v[2] == long_a);
+
+    v.push_back(v[1]);
+    assert(v.size() == v.capacity());
+    v.emplace_back(v[3]);
+    assert(v.size() == 5);
+    assert(v[3] == long_b && v[4] == long_b);
+
+    v.push_back(std::move(v[0]));
+    assert(v.size() == 6 && v[5] == long_a);
+}
+
+static void test_copy_and_move()
+{
+    small_vector<std::string, 2> inline_v { long_a };
+    small_vector<std::string, 2> heap_v { long_a, long_b, long_a };
+
+    auto copy = heap_v;
+    assert(copy.size() == 3 && copy[1] == long_b);
+
+    auto moved = std::move(inline_v);
+    assert(moved.is_inline() && moved.size() == 1 && moved[0] == long_a);
+    assert(inline_v.empty());
+
+    moved = std::move(heap_v);
+    assert(!moved.is_inline() && moved.size() == 3 && moved[2] == long_a);
+    assert(heap_v.empty() && heap_v.is_inline());
+
+    moved.erase(moved.begin());
+    assert(moved.size() == 2 && moved[0] == long_b && moved[1] == long_a);
+}
+
+int main()
+{
+    test_self_insertion();
+    test_copy_and_move();
+    return 0;
+}